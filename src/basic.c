@@ -51,6 +51,12 @@ void bas_put_ascii (BASPROG *self, char *s)
     self->line_size += len;
 }
 
+void bas_put_data (BASPROG *self, const char *src, unsigned int len)
+{
+    memcpy (self->data + self->size + 4 + self->line_size, src, len);
+    self->line_size += len;
+}
+
 /* Valid range for integer is [-65535; 65535] */
 
 void bas_put_int_ascii (BASPROG *self, int i)
@@ -83,48 +89,200 @@ void bas_put_int (BASPROG *self, int i)
     bas_put_int_integral (self, i);
 }
 
-void bas_put_int_compact (BASPROG *self, int i)
+/* Rough estimates of T-states taken by ROM to interpret parts of a number
+   (only their order matters) */
+#define TIME_CHAR       60      /* fetching a character of a line */
+#define TIME_HIDDEN     400     /* stacking a hidden 5-byte number */
+#define TIME_NEGATE     300     /* unary minus */
+#define TIME_PI         1000    /* stacking PI by calculator */
+#define TIME_NOT        300
+#define TIME_SGN        300
+#define TIME_INT        1500    /* truncating a fractional number */
+#define TIME_STRING     500     /* stacking a string */
+#define TIME_CODE       400
+#define TIME_VAL        3000    /* copying string to work space and scanning
+                                   it twice */
+#define TIME_VAL_DIGIT  2000    /* multiplying by 10 and adding a digit */
+#define TIME_VAL_EXP    3000    /* scaling by a power of 10 */
+
+/* A candidate encoding of a number and its cost */
+/* Length of a candidate which does not fit into `text' */
+#define NUM_TOO_LONG (BAS_MAX_INT_LEN + 1)
+
+struct number_t
 {
-    /* only those numbers are implemented that
-       are relatively fast interpreted by BASIC */
-    unsigned int n;
+    char text[BAS_MAX_INT_LEN];
+    unsigned int len;
+    unsigned long time;
+};
 
-    if (i < 0)
+static void num_start (struct number_t *n, char negative)
+{
+    n->len = 0;
+    n->time = 0;
+    if (negative)
     {
-        bas_put_char (self, '-');
-        n = -i;
+        n->text[n->len++] = '-';
+        n->time = TIME_NEGATE + TIME_CHAR;
     }
-    else
-        n = i;
-    if (n == 0)
-        bas_put_ascii (self, SYM_NOT SYM_PI);
-    else if (n == 1)
-        bas_put_ascii (self, SYM_SGN SYM_PI);
-    else if (n == 3)
-        bas_put_ascii (self, SYM_INT SYM_PI);
-    else if (n >= 32 && n != '"' && n <= 255)
+}
+
+/* Puts characters `s' of `len' bytes interpreted in `time' T-states besides
+   fetching them */
+static void num_put (struct number_t *n, const char *s, unsigned int len,
+    unsigned long time)
+{
+    if (n->len + len > BAS_MAX_INT_LEN)
     {
-        bas_put_ascii (self, SYM_CODE "\"");
-        bas_put_char (self, n);
-        bas_put_char (self, '"');
+        n->len = NUM_TOO_LONG;
+        return;
     }
+    memcpy (n->text + n->len, s, len);
+    n->len += len;
+    n->time += time + len * TIME_CHAR;
+}
+
+/* Puts hidden 5-byte form of `i' (see `bas_put_int_integral()') skipped when
+   fetching characters */
+static void num_put_hidden (struct number_t *n, int i)
+{
+    unsigned int u = i < 0 ? i + 0x10000 : i;
+    char *p = n->text + n->len;
+
+    if (n->len + BAS_HIDDEN_NUM_LEN > BAS_MAX_INT_LEN)
+    {
+        n->len = NUM_TOO_LONG;
+        return;
+    }
+    p[0] = 0x0E;
+    p[1] = 0x00;
+    p[2] = i < 0 ? 0xFF : 0x00;
+    p[3] = u % 256;
+    p[4] = u / 256;
+    p[5] = 0x00;
+    n->len += BAS_HIDDEN_NUM_LEN;
+    n->time += TIME_HIDDEN;
+}
+
+/* Replaces `best' by `n' if `n' fits and is cheaper by `cost' model */
+static void num_try (struct number_t *best, const struct number_t *n, char cost)
+{
+    char better;
+
+    if (n->len > BAS_MAX_INT_LEN)
+        return;
+    if (cost == BAS_COST_TIME)
+        better = n->time < best->time
+            ||  (n->time == best->time && n->len < best->len);
+    else
+        better = n->len < best->len
+            ||  (n->len == best->len && n->time < best->time);
+    if (better)
+        *best = *n;
+}
+
+/* Puts decimal digits of `u' into `s' (5 bytes long). Returns their count. */
+static unsigned int get_digits (char *s, unsigned int u)
+{
+    char buf[5];
+    unsigned int i = sizeof (buf);
+
+    do
+        buf[--i] = '0' + u % 10;
+    while (u /= 10);
+    memcpy (s, buf + i, sizeof (buf) - i);
+    return sizeof (buf) - i;
+}
+
+/* Makes the cheapest encoding of number `i' by `cost' model (`BAS_COST_SIZE'
+   or `BAS_COST_TIME') in `dest' (`BAS_MAX_INT_LEN' bytes long). Returns its
+   length.
+
+   Tried forms are: the hidden form after visible digits or "0", NOT PI,
+   SGN PI, INT PI, CODE "c" and VAL "n" (with shortest exponent if any).
+   BIN needs the hidden form too and other expressions of PI take more bytes
+   than VAL and more time than the hidden form, so they are never the best. */
+unsigned int bas_make_int (char *dest, int i, char cost)
+{
+    static const char *const small[4] =
+    {
+        SYM_NOT SYM_PI, SYM_SGN SYM_PI, NULL, SYM_INT SYM_PI
+    };
+    static const unsigned long small_time[4] =
+    {
+        TIME_PI + TIME_NOT, TIME_PI + TIME_SGN, 0, TIME_PI + TIME_INT
+    };
+    struct number_t best, n;
+    char s[5], c;
+    unsigned int u = i < 0 ? -i : i, len, k, m;
+
+    len = get_digits (s, u);
+
+    /* the hidden form is used by interpreter, visible text is just skipped */
+    num_start (&best, 0);
+    if (i < 0)
+        num_put (&best, "0", 1, 0);
     else
+        num_put (&best, s, len, 0);
+    num_put_hidden (&best, i);
+    num_start (&n, 0);
+    num_put (&n, "0", 1, 0);
+    num_put_hidden (&n, i);
+    num_try (&best, &n, cost);
+
+    /* the rest forms are of absolute value */
+    if (u < 4 && small[u])
     {
-        bas_put_ascii (self, SYM_VAL "\"");
-        if (!(n % 10000))
-        {
-            bas_put_int_ascii (self, n / 10000);
-            bas_put_ascii (self, "e4");
-	}
-        else if (!(n % 1000))
+        num_start (&n, i < 0);
+        num_put (&n, small[u], 2, small_time[u]);
+        num_try (&best, &n, cost);
+    }
+
+    if (u >= 32 && u <= 255)
+    {
+        /* quote in a string is doubled */
+        c = u;
+        num_start (&n, i < 0);
+        num_put (&n, SYM_CODE "\"", 2, TIME_STRING + TIME_CODE);
+        if (c == '"')
+            num_put (&n, "\"", 1, 0);
+        num_put (&n, &c, 1, 0);
+        num_put (&n, "\"", 1, 0);
+        num_try (&best, &n, cost);
+    }
+
+    for (k = 0, m = u;; k++, m /= 10)
+    {
+        len = get_digits (s, m);
+        num_start (&n, i < 0);
+        num_put (&n, SYM_VAL "\"", 2, TIME_VAL + TIME_STRING);
+        num_put (&n, s, len, len * TIME_VAL_DIGIT);
+        if (k)
         {
-            bas_put_int_ascii (self, n / 1000);
-            bas_put_ascii (self, "e3");
-	}
-        else
-            bas_put_int_ascii (self, n);
-        bas_put_char (self, '"');
+            c = '0' + k;
+            num_put (&n, "e", 1, TIME_VAL_EXP);
+            num_put (&n, &c, 1, 0);
+        }
+        num_put (&n, "\"", 1, 0);
+        num_try (&best, &n, cost);
+        if (!m || m % 10)
+            break;
     }
+
+    memcpy (dest, best.text, best.len);
+    return best.len;
+}
+
+void bas_put_int_best (BASPROG *self, int i, char cost)
+{
+    char s[BAS_MAX_INT_LEN];
+
+    bas_put_data (self, s, bas_make_int (s, i, cost));
+}
+
+void bas_put_int_compact (BASPROG *self, int i)
+{
+    bas_put_int_best (self, i, BAS_COST_SIZE);
 }
 
 void bas_put_int_secret (BASPROG *self, int i)
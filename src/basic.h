@@ -16,13 +16,21 @@
 /* BASIC lexems (numbers) */
 #define LEX_CR          0x0D
 #define LEX_PI          0xA7
+#define LEX_FN          0xA8
+#define LEX_SCREEN      0xAA
+#define LEX_AT          0xAC
 #define LEX_CODE        0xAF
 #define LEX_VAL         0xB0
 #define LEX_INT         0xBA
 #define LEX_SGN         0xBC
 #define LEX_USR         0xC0
-#define LEX_AT          0xC1
 #define LEX_NOT         0xC3
+#define LEX_BIN         0xC4
+#define LEX_OR          0xC5
+#define LEX_LE          0xC7
+#define LEX_GE          0xC8
+#define LEX_NE          0xC9
+#define LEX_DEF_FN      0xCE
 #define LEX_INK         0xD9
 #define LEX_PAPER       0xDA
 #define LEX_FLASH       0xDB
@@ -41,13 +49,21 @@
 /* BASIC lexems (characters) to form an ASCIZ string */
 #define SYM_CR          "\x0D"
 #define SYM_PI          "\xA7"
+#define SYM_FN          "\xA8"
+#define SYM_SCREEN      "\xAA"
+#define SYM_AT          "\xAC"
 #define SYM_CODE        "\xAF"
 #define SYM_VAL         "\xB0"
 #define SYM_INT         "\xBA"
 #define SYM_SGN         "\xBC"
 #define SYM_USR         "\xC0"
-#define SYM_AT          "\xC1"
 #define SYM_NOT         "\xC3"
+#define SYM_BIN         "\xC4"
+#define SYM_OR          "\xC5"
+#define SYM_LE          "\xC7"
+#define SYM_GE          "\xC8"
+#define SYM_NE          "\xC9"
+#define SYM_DEF_FN      "\xCE"
 #define SYM_INK         "\xD9"
 #define SYM_PAPER       "\xDA"
 #define SYM_FLASH       "\xDB"
@@ -63,6 +79,16 @@
 #define SYM_CLS         "\xFB"
 #define SYM_CLEAR       "\xFD"
 
+/* Cost models of numbers encoding */
+#define BAS_COST_SIZE   0   /* fewest bytes */
+#define BAS_COST_TIME   1   /* fastest interpreted */
+
+/* Length of hidden 5-byte form of number with its 0x0E prefix */
+#define BAS_HIDDEN_NUM_LEN  6
+
+/* Maximal length of encoded number (5 visible digits and hidden form) */
+#define BAS_MAX_INT_LEN (5 + BAS_HIDDEN_NUM_LEN)
+
 typedef struct
 {
     char *data;
@@ -78,9 +104,12 @@ void bas_start_line (BASPROG *self, unsigned int num);
 void bas_new_line (BASPROG *self);
 void bas_put_char (BASPROG *self, char c);
 void bas_put_ascii (BASPROG *self, char *s);
+void bas_put_data (BASPROG *self, const char *src, unsigned int len);
 void bas_put_int_ascii (BASPROG *self, int i);
 void bas_put_int_integral (BASPROG *self, int i);
 void bas_put_int (BASPROG *self, int i);
+unsigned int bas_make_int (char *dest, int i, char cost);
+void bas_put_int_best (BASPROG *self, int i, char cost);
 void bas_put_int_compact (BASPROG *self, int i);
 void bas_put_int_secret (BASPROG *self, int i);
 void bas_end_line (BASPROG *self);
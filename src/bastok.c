@@ -0,0 +1,764 @@
+/* bastok.c - ZX Spectrum BASIC tokenizer.
+
+   `bastok.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "basic.h"
+#include "bastok.h"
+
+#define MAX_LINE_NUMBER 9999
+#define MAX_NUMBER_TEXT 64      /* longest text of a number */
+
+/* Keywords in order of their codes from `BASTOK_FIRST_KEYWORD'. A space
+   matches any number of spaces (none too). */
+static const char *const keywords[] =
+{
+    "RND", "INKEY$", "PI", "FN", "POINT", "SCREEN$", "ATTR", "AT", "TAB",
+    "VAL$", "CODE", "VAL", "LEN", "SIN", "COS", "TAN", "ASN", "ACS", "ATN",
+    "LN", "EXP", "INT", "SQR", "SGN", "ABS", "PEEK", "IN", "USR", "STR$",
+    "CHR$", "NOT", "BIN", "OR", "AND", "<=", ">=", "<>", "LINE", "THEN", "TO",
+    "STEP", "DEF FN", "CAT", "FORMAT", "MOVE", "ERASE", "OPEN #", "CLOSE #",
+    "MERGE", "VERIFY", "BEEP", "CIRCLE", "INK", "PAPER", "FLASH", "BRIGHT",
+    "INVERSE", "OVER", "OUT", "LPRINT", "LLIST", "STOP", "READ", "DATA",
+    "RESTORE", "NEW", "BORDER", "CONTINUE", "DIM", "REM", "FOR", "GO TO",
+    "GO SUB", "INPUT", "LOAD", "LIST", "LET", "PAUSE", "NEXT", "POKE", "PRINT",
+    "PLOT", "RUN", "SAVE", "RANDOMIZE", "IF", "CLS", "DRAW", "CLEAR", "RETURN",
+    "COPY"
+};
+
+/* Codes of keywords starting with a letter in alphabetical order */
+static const unsigned char sorted[] =
+{
+    /* A */ 0xBD, 0xB6, 0xC6, 0xB5, 0xAC, 0xB7, 0xAB,
+    /* B */ 0xD7, 0xC4, 0xE7, 0xDC,
+    /* C */ 0xCF, 0xC2, 0xD8, 0xFD, 0xD4, 0xFB, 0xAF, 0xE8, 0xFF, 0xB3,
+    /* D */ 0xE4, 0xCE, 0xE9, 0xFC,
+    /* E */ 0xD2, 0xB9,
+    /* F */ 0xDB, 0xA8, 0xEB, 0xD0,
+    /* G */ 0xED, 0xEC,
+    /* I */ 0xFA, 0xBF, 0xD9, 0xA6, 0xEE, 0xBA, 0xDD,
+    /* L */ 0xB1, 0xF1, 0xCA, 0xF0, 0xE1, 0xB8, 0xEF, 0xE0,
+    /* M */ 0xD5, 0xD1,
+    /* N */ 0xE6, 0xF3, 0xC3,
+    /* O */ 0xD3, 0xC5, 0xDF, 0xDE,
+    /* P */ 0xDA, 0xF2, 0xBE, 0xA7, 0xF6, 0xA9, 0xF4, 0xF5,
+    /* R */ 0xF9, 0xE3, 0xEA, 0xE5, 0xFE, 0xA5, 0xF7,
+    /* S */ 0xF8, 0xAA, 0xBC, 0xB2, 0xBB, 0xCD, 0xE2, 0xC1,
+    /* T */ 0xAD, 0xB4, 0xCB, 0xCC,
+    /* U */ 0xC0,
+    /* V */ 0xB0, 0xAE, 0xD6
+};
+
+/* Index in `sorted' of the first keyword starting with each letter, the last
+   one is the end of the table */
+static const unsigned char first[27] =
+{
+    0, 7, 11, 21, 25, 27, 31, 33, 33, 40, 40, 40, 48, 50, 53, 57, 65, 65, 72,
+    80, 84, 85, 88, 88, 88, 88, 88
+};
+
+/* Block graphics halves of a character cell: bit 0 - top, bit 1 - bottom */
+static const char halves[4] = { ' ', '\'', '.', ':' };
+
+struct tokenizer_t
+{
+    char *dest;
+    unsigned int capacity;
+    unsigned int size;      /* size of completed lines */
+    unsigned int len;       /* length of text of current line */
+    unsigned int spaces;    /* trailing spaces of current line */
+    char overflow;
+};
+
+const char *bastok_strerror (int err)
+{
+    switch (err)
+    {
+    case BASTOK_OK:
+        return "Success";
+    case BASTOK_ERR_LINE_NUMBER:
+        return "Invalid line number";
+    case BASTOK_ERR_LINE_ORDER:
+        return "Line numbers are not ascending";
+    case BASTOK_ERR_NUMBER:
+        return "Number is out of range";
+    case BASTOK_ERR_ESCAPE:
+        return "Invalid escape sequence";
+    case BASTOK_ERR_TOO_LONG:
+        return "Program is too long";
+    default:
+        return "Unknown error";
+    }
+}
+
+/* Returns text of keyword `code' or NULL if it is not a keyword */
+const char *bastok_get_keyword (unsigned char code)
+{
+    if (code < BASTOK_FIRST_KEYWORD)
+        return NULL;
+    return keywords[code - BASTOK_FIRST_KEYWORD];
+}
+
+static void put_char (struct tokenizer_t *t, char c)
+{
+    unsigned int i = t->size + 4 + t->len++;
+
+    if (i < t->capacity)
+        t->dest[i] = c;
+    else
+        t->overflow = 1;
+    t->spaces = 0;
+}
+
+/* Puts character of text, trailing spaces are counted to be removed before
+   a keyword */
+static void put_text_char (struct tokenizer_t *t, char c)
+{
+    unsigned int spaces = t->spaces;
+
+    put_char (t, c);
+    if (c == ' ')
+        t->spaces = spaces + 1;
+}
+
+/* Makes hidden 5-byte form of number `v' (not negative) in `b'. Returns 0 on
+   success. */
+static char make_value (unsigned char *b, double v)
+{
+    unsigned long long m;
+    unsigned int u;
+    int e = 0;
+
+    /* infinity and NaN too */
+    if (!(v < 1e39))
+        return 1;
+
+    if (v <= 65535 && v == (u = v))
+    {
+        /* integral form */
+        b[0] = 0x00;
+        b[1] = 0x00;
+        b[2] = u % 256;
+        b[3] = u / 256;
+        b[4] = 0x00;
+        return 0;
+    }
+
+    /* v = mantissa * 2^e, mantissa is in [0.5; 1) */
+    while (v >= 1)
+    {
+        v /= 2;
+        e++;
+    }
+    while (v < 0.5)
+    {
+        v *= 2;
+        e--;
+    }
+    m = v * 4294967296.0 + 0.5;
+    if (m >> 32)
+    {
+        m >>= 1;
+        e++;
+    }
+    if (e > 127)
+        return 1;
+    if (e < -127)
+        m = e = 0;  /* too small, zero */
+    else
+        e += 128;
+    b[0] = e;
+    b[1] = (m >> 24) & 0x7F;    /* the top bit is sign */
+    b[2] = m >> 16;
+    b[3] = m >> 8;
+    b[4] = m;
+    return 0;
+}
+
+/* Puts hidden form of number `v'. Returns 0 on success. */
+static char put_value (struct tokenizer_t *t, double v)
+{
+    unsigned char b[5];
+    unsigned int i;
+
+    if (make_value (b, v))
+        return 1;
+    put_char (t, 0x0E);
+    for (i = 0; i < 5; i++)
+        put_char (t, b[i]);
+    return 0;
+}
+
+/* Matches keyword `k' at `p' (`e' is the end of line) ignoring case. Returns
+   the length of matched text or 0. */
+static unsigned int match_keyword (const char *k, const char *p, const char *e)
+{
+    const char *s = p;
+    char c;
+
+    for (; *k; k++)
+    {
+        if (*k == ' ')
+        {
+            while (s < e && *s == ' ')
+                s++;
+            continue;
+        }
+        if (s == e)
+            return 0;
+        c = *s++;
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if (c != *k)
+            return 0;
+    }
+    /* a keyword is not a part of a longer word */
+    if (isalpha ((unsigned char) k[-1]) && s < e && isalpha ((unsigned char) *s))
+        return 0;
+    return s - p;
+}
+
+/* Finds the longest keyword at `p'. Returns its code and the length of matched
+   text in `len' or 0 if there is no keyword. */
+static unsigned char find_keyword (const char *p, const char *e, unsigned int *len)
+{
+    unsigned int i, l, letter;
+    unsigned char code = 0;
+    const char *k;
+    char next;
+
+    *len = 0;
+    if (*p == '<' || *p == '>')
+    {
+        if (p + 1 < e && p[1] == '=')
+            code = *p == '<' ? LEX_LE : LEX_GE;
+        else if (*p == '<' && p + 1 < e && p[1] == '>')
+            code = LEX_NE;
+        if (code)
+            *len = 2;
+        return code;
+    }
+
+    letter = toupper ((unsigned char) *p) - 'A';
+    next = p + 1 < e ? toupper ((unsigned char) p[1]) : 0;
+    for (i = first[letter]; i < first[letter + 1]; i++)
+    {
+        k = keywords[sorted[i] - BASTOK_FIRST_KEYWORD];
+        /* the first letter is matched already, the second one mostly fails */
+        if (k[1] != next)
+            continue;
+        l = match_keyword (k, p, e);
+        if (l > *len)
+        {
+            *len = l;
+            code = sorted[i];
+        }
+    }
+    return code;
+}
+
+/* Puts character written as escape sequence at `p' (after backslash). Returns
+   pointer after the sequence or NULL if it is invalid. */
+static const char *put_escape (struct tokenizer_t *t, const char *p, const char *e)
+{
+    const char *l, *r;
+    unsigned int n, digit, base = 10;
+    char c;
+
+    if (p == e)
+        return NULL;
+    c = *p++;
+    if (c == '\\' || c == '*')
+    {
+        put_char (t, c == '*' ? 0x7F : c);
+        return p;
+    }
+    if (tolower ((unsigned char) c) >= 'a' && tolower ((unsigned char) c) <= 'u')
+    {
+        put_char (t, 0x90 + tolower ((unsigned char) c) - 'a');
+        return p;
+    }
+    if (c == '{')
+    {
+        if (e - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        {
+            base = 16;
+            p += 2;
+        }
+        for (n = 0, l = p; p < e && isxdigit ((unsigned char) *p); p++)
+        {
+            digit = isdigit ((unsigned char) *p) ? *p - '0'
+                : tolower ((unsigned char) *p) - 'a' + 10;
+            if (digit >= base || (n = n * base + digit) > 255)
+                return NULL;
+        }
+        if (p == l || p == e || *p != '}')
+            return NULL;
+        put_char (t, n);
+        return p + 1;
+    }
+    l = memchr (halves, c, sizeof (halves));
+    r = p < e ? memchr (halves, *p, sizeof (halves)) : NULL;
+    if (!l || !r)
+        return NULL;
+    n = l - halves;
+    digit = r - halves;
+    /* bits: 0 - top right, 1 - top left, 2 - bottom right, 3 - bottom left */
+    put_char (t, 0x80 | (digit & 1) | (n & 1) << 1 | (digit & 2) << 1 | (n & 2) << 2);
+    return p + 1;
+}
+
+/* Puts text from `p' to `c' character (included) or to the end of line `e'.
+   Returns pointer after the text or NULL on invalid escape sequence. */
+static const char *put_text (struct tokenizer_t *t, const char *p, const char *e, char c)
+{
+    while (p < e)
+    {
+        if (*p == '\\')
+        {
+            p = put_escape (t, p + 1, e);
+            if (!p)
+                return NULL;
+            continue;
+        }
+        put_char (t, *p);
+        if (*p++ == c)
+            break;
+    }
+    return p;
+}
+
+/* Puts number at `p' followed by its hidden form. Returns pointer after the
+   number or NULL if it is out of range. */
+static const char *put_number (struct tokenizer_t *t, const char *p, const char *e)
+{
+    char text[MAX_NUMBER_TEXT + 1];
+    const char *s = p, *x;
+    unsigned long n = 0;
+
+    for (; s < e && isdigit ((unsigned char) *s) && n <= 65535; s++)
+        n = n * 10 + *s - '0';
+    if ((s == e || (*s != '.' && *s != 'e' && *s != 'E' && !isdigit ((unsigned char) *s)))
+    &&  n <= 65535)
+    {
+        /* integral number is the most often one */
+        for (x = p; x < s; x++)
+            put_char (t, *x);
+        put_value (t, n);
+        return s;
+    }
+
+    while (s < e && isdigit ((unsigned char) *s))
+        s++;
+    if (s < e && *s == '.')
+        for (s++; s < e && isdigit ((unsigned char) *s); s++)
+            ;
+    if (s < e && (*s == 'e' || *s == 'E'))
+    {
+        /* exponent, not a name */
+        x = s + 1;
+        if (x < e && (*x == '+' || *x == '-'))
+            x++;
+        if (x < e && isdigit ((unsigned char) *x))
+            for (s = x; s < e && isdigit ((unsigned char) *s); s++)
+                ;
+    }
+    if (s - p > MAX_NUMBER_TEXT)
+        return NULL;
+    memcpy (text, p, s - p);
+    text[s - p] = 0;
+    for (x = p; x < s; x++)
+        put_char (t, *x);
+    return put_value (t, strtod (text, NULL)) ? NULL : s;
+}
+
+/* Puts binary number at `p' (after `BIN') followed by its hidden form */
+static const char *put_binary (struct tokenizer_t *t, const char *p, const char *e)
+{
+    double v = 0;
+
+    for (; p < e && (*p == '0' || *p == '1'); p++)
+    {
+        put_char (t, *p);
+        v = v * 2 + *p - '0';
+    }
+    return put_value (t, v) ? NULL : p;
+}
+
+/* Tokenizes text of a line from `p' to `e'. Returns error code. */
+static int tokenize_line (struct tokenizer_t *t, const char *p, const char *e)
+{
+    unsigned int len;
+    unsigned char code;
+    char ident = 0;     /* inside a name */
+    char def_fn = 0;    /* 1 - after `DEF FN', 2 - inside its parameters */
+    char c;
+
+    while (p < e)
+    {
+        c = *p;
+
+        /* parameters of `DEF FN' get hidden place for their values */
+        if (def_fn == 2 && isalpha ((unsigned char) c))
+        {
+            put_char (t, c);
+            if (++p < e && *p == '$')
+                put_char (t, *p++);
+            put_char (t, 0x0E);
+            for (len = 0; len < 5; len++)
+                put_char (t, 0x00);
+            continue;
+        }
+        if (def_fn && (c == '(' || c == ')' || c == '='))
+            def_fn = c == '(' ? 2 : 0;
+
+        if (c == '"' || c == '\\')
+        {
+            if (c == '"')
+            {
+                put_char (t, c);
+                p = put_text (t, p + 1, e, '"');
+            }
+            else
+                p = put_escape (t, p + 1, e);
+            if (!p)
+                return BASTOK_ERR_ESCAPE;
+            ident = 0;
+            continue;
+        }
+
+        if (((!ident && isalpha ((unsigned char) c)) || c == '<' || c == '>')
+        &&  (code = find_keyword (p, e, &len)) != 0)
+        {
+            p += len;
+            if (isalpha ((unsigned char) c))
+            {
+                /* spaces around keyword are added by ROM when listing */
+                t->len -= t->spaces;
+                while (p < e && *p == ' ' && code != LEX_REM)
+                    p++;
+            }
+            put_char (t, code);
+            ident = 0;
+            if (code == LEX_REM)
+            {
+                if (p < e && *p == ' ')
+                    p++;
+                return put_text (t, p, e, 0) ? BASTOK_OK : BASTOK_ERR_ESCAPE;
+            }
+            if (code == LEX_DEF_FN)
+                def_fn = 1;
+            if (code == LEX_BIN && !(p = put_binary (t, p, e)))
+                return BASTOK_ERR_NUMBER;
+            continue;
+        }
+
+        if (!ident && (isdigit ((unsigned char) c)
+            || (c == '.' && p + 1 < e && isdigit ((unsigned char) p[1]))))
+        {
+            p = put_number (t, p, e);
+            if (!p)
+                return BASTOK_ERR_NUMBER;
+            continue;
+        }
+
+        put_text_char (t, c);
+        p++;
+        ident = isalpha ((unsigned char) c) || (ident && isdigit ((unsigned char) c));
+    }
+    return BASTOK_OK;
+}
+
+/* Tokenizes BASIC program text `src' of `len' bytes into `dest' (`capacity'
+   bytes long). Returns error code and the size of the program in `size'. On
+   error the number of the line of text is returned in `err_line'. */
+int bastok_tokenize (char *dest, unsigned int capacity, const char *src,
+    unsigned long len, unsigned int *size, unsigned long *err_line)
+{
+    struct tokenizer_t t;
+    const char *end = src + len, *eol, *e, *p;
+    unsigned int num;
+    long last = -1;
+    int err;
+
+    t.dest = dest;
+    t.capacity = capacity;
+    t.size = 0;
+    t.overflow = 0;
+    *err_line = 0;
+
+    for (p = src; p < end; p = eol + (eol < end))
+    {
+        ++*err_line;
+        eol = memchr (p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        e = eol;
+        if (e > p && e[-1] == '\r')
+            e--;
+
+        while (p < e && isspace ((unsigned char) *p))
+            p++;
+        if (p == e || *p == '#')
+            continue;
+
+        if (!isdigit ((unsigned char) *p))
+            return BASTOK_ERR_LINE_NUMBER;
+        for (num = 0; p < e && isdigit ((unsigned char) *p); p++)
+            if ((num = num * 10 + *p - '0') > MAX_LINE_NUMBER)
+                return BASTOK_ERR_LINE_NUMBER;
+        if ((long) num <= last)
+            return BASTOK_ERR_LINE_ORDER;
+        last = num;
+        while (p < e && *p == ' ')
+            p++;
+
+        t.len = 0;
+        t.spaces = 0;
+        err = tokenize_line (&t, p, e);
+        if (err)
+            return err;
+        put_char (&t, LEX_CR);
+        if (t.overflow)
+            return BASTOK_ERR_TOO_LONG;
+
+        dest[t.size] = num / 256;
+        dest[t.size + 1] = num % 256;
+        dest[t.size + 2] = t.len % 256;
+        dest[t.size + 3] = t.len / 256;
+        t.size += 4 + t.len;
+    }
+
+    *size = t.size;
+    *err_line = 0;
+    return BASTOK_OK;
+}
+
+/* Puts character `c' of text into `p' as is or as escape sequence */
+static char *list_char (char *p, unsigned char c)
+{
+    if (c >= 32 && c < 127 && c != '\\')
+        *p++ = c;
+    else if (c == '\\' || c == 0x7F)
+    {
+        *p++ = '\\';
+        *p++ = c == '\\' ? c : '*';
+    }
+    else if (c >= 0x80 && c < 0x90)
+    {
+        /* bits: 0 - top right, 1 - top left, 2 - bottom right, 3 - bottom left */
+        *p++ = '\\';
+        *p++ = halves[(c >> 1 & 1) | (c >> 2 & 2)];
+        *p++ = halves[(c & 1) | (c >> 1 & 2)];
+    }
+    else if (c >= 0x90 && c < BASTOK_FIRST_KEYWORD)
+    {
+        *p++ = '\\';
+        *p++ = 'a' + c - 0x90;
+    }
+    else
+    {
+        *p++ = '\\';
+        *p++ = '{';
+        if (c >= 100)
+            *p++ = '0' + c / 100;
+        if (c >= 10)
+            *p++ = '0' + c / 10 % 10;
+        *p++ = '0' + c % 10;
+        *p++ = '}';
+    }
+    return p;
+}
+
+/* Puts keyword `code' into `p' with spaces around it as ROM does */
+static char *list_keyword (char *p, char *start, unsigned char code)
+{
+    const char *k = keywords[code - BASTOK_FIRST_KEYWORD];
+    char symbol = code >= LEX_LE && code <= LEX_NE;
+
+    /* operators and statements are separated from the previous text */
+    if (code >= LEX_OR && !symbol && p > start && p[-1] != ' ')
+        *p++ = ' ';
+    while (*k)
+        *p++ = *k++;
+    /* functions, operators and statements are followed by their arguments */
+    if (code >= LEX_FN && !symbol)
+        *p++ = ' ';
+    return p;
+}
+
+/* Puts number of hidden form `b' into `p' if visible text of the number from
+   `start' to `p' has another value. Returns the end of the number. */
+static char *list_hidden (char *p, char *start, const unsigned char *b)
+{
+    char text[MAX_NUMBER_TEXT + 1];
+    unsigned char v[5];
+    double x;
+    int n;
+
+    if (p - start <= MAX_NUMBER_TEXT)
+    {
+        memcpy (text, start, p - start);
+        text[p - start] = 0;
+        if (!make_value (v, strtod (text, NULL)) && !memcmp (v, b, 5))
+            return p;
+    }
+
+    if (!b[0])
+    {
+        n = b[2] + b[3] * 256;
+        if (b[1])
+            n -= 65536;     /* negative sign */
+        return start + sprintf (start, "%d", n);
+    }
+    x = (double) ((unsigned long) (b[1] | 0x80) << 24 | b[2] << 16 | b[3] << 8 | b[4])
+        / 4294967296.0;
+    for (n = b[0] - 128; n > 0; n--)
+        x *= 2;
+    for (; n < 0; n++)
+        x /= 2;
+    return start + sprintf (start, "%s%.10g", b[1] & 0x80 ? "-" : "", x);
+}
+
+/* Lists the first line of program `src' of `len' bytes as text into `dest'
+   (`BASTOK_MAX_TEXT_LEN (len)' bytes long) ended by a newline. Hidden forms of
+   numbers are skipped, characters out of ASCII are written as escape
+   sequences. Returns the length of the text and the size of the line in
+   program in `size' (0 when the program ends: line is truncated or its number
+   is out of range). */
+unsigned int bastok_list_line (char *dest, const char *src, unsigned int len,
+    unsigned int *size)
+{
+    const unsigned char *s = (const unsigned char *) src + 4, *e;
+    char quote = 0, rem = 0, bin = 0, *p = dest, *start, *pad = NULL;
+    char *number = NULL;    /* start of text of a number */
+    unsigned int num, i;
+    unsigned char c;
+
+    *size = 0;
+    if (len < 4)
+        return 0;
+    num = (unsigned char) src[0] * 256 + (unsigned char) src[1];
+    i = (unsigned char) src[2] + (unsigned char) src[3] * 256;
+    if (num > 16383 || i > len - 4)
+        return 0;
+    *size = 4 + i;
+    e = s + i;
+    /* the line ends with `LEX_CR' */
+    if (e > s && e[-1] == LEX_CR)
+        e--;
+
+    for (i = 10000; i > 1 && i > num; i /= 10)
+        ;
+    for (; i; i /= 10)
+        *p++ = '0' + num / i % 10;
+    *p++ = ' ';
+    start = p;
+
+    while (s < e)
+    {
+        c = *s++;
+        if (quote || rem)
+        {
+            p = list_char (p, c);
+            if (c == '"')
+                quote = 0;
+        }
+        else if (c == 0x0E && e - s >= 5)
+        {
+            /* hidden form of a number is shown if visible text lies */
+            if (number && !bin)
+                p = list_hidden (p, number, s);
+            s += 5;
+            number = NULL;
+            bin = 0;
+        }
+        else if (c >= BASTOK_FIRST_KEYWORD)
+        {
+            p = list_keyword (p, start, c);
+            pad = p;
+            rem = c == LEX_REM;
+            bin = c == LEX_BIN;
+            number = NULL;
+        }
+        else
+        {
+            if (isdigit (c) || c == '.')
+            {
+                if (!number && (p == start || !isalnum ((unsigned char) p[-1])))
+                    number = p;
+            }
+            else if (!(number && (c == 'e' || c == 'E' || c == '+' || c == '-')))
+                number = NULL;
+            p = list_char (p, c);
+            quote = c == '"';
+        }
+    }
+
+    /* no space after the last keyword */
+    if (p == pad && p[-1] == ' ')
+        p--;
+    *p++ = '\n';
+    return p - dest;
+}
+
+/* Lists `len' characters of `src' like text of a string into `dest'
+   (`BASTOK_MAX_STRING_LEN (len)' bytes long) ended by zero. A quote is written
+   as `\{34}', so the text may be put in double quotes. Returns its length. */
+unsigned int bastok_list_string (char *dest, const char *src, unsigned int len)
+{
+    char *p = dest;
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+        if (src[i] == '"')
+        {
+            memcpy (p, "\\{34}", 5);
+            p += 5;
+        }
+        else
+            p = list_char (p, src[i]);
+    *p = '\0';
+    return p - dest;
+}
+
+/* Reads text `src' of `len' bytes with escape sequences into `dest'
+   (`capacity' bytes long). Returns the number of characters in `size'. */
+int bastok_read_string (char *dest, unsigned int capacity, const char *src,
+    unsigned int len, unsigned int *size)
+{
+    const char *e = src + len;
+    struct tokenizer_t t;
+    char c[5];
+
+    *size = 0;
+    while (src < e)
+    {
+        if (*src == '\\')
+        {
+            /* the character is put after room of a line header */
+            t.dest = c;
+            t.capacity = sizeof (c);
+            t.size = 0;
+            t.len = 0;
+            src = put_escape (&t, src + 1, e);
+            if (!src)
+                return BASTOK_ERR_ESCAPE;
+        }
+        else
+            c[4] = *src++;
+        if (*size == capacity)
+            return BASTOK_ERR_TOO_LONG;
+        dest[(*size)++] = c[4];
+    }
+    return BASTOK_OK;
+}
@@ -0,0 +1,58 @@
+/* bastok.h - declarations for `bastok.c'.
+
+   `bastok.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _bastok_h
+#define _bastok_h 1
+
+/* ZX Spectrum BASIC tokenizer. Text of a program is a sequence of lines
+   starting with a line number (empty lines and lines starting with `#' are
+   skipped). Keywords (in any case, `GOTO' and `GO TO' are the same) are turned
+   into tokens, spaces around them are removed, numbers get hidden 5-byte form
+   after their text. Text of strings and `REM' statements is copied as is.
+   Characters out of ASCII are written as escape sequences:
+     `\a'..`\u'     user defined graphics (144..164),
+     `\XY'          block graphics, `X' and `Y' are the left and right halves
+                    of a character cell: ` ' (empty), `'' (top), `.' (bottom)
+                    or `:' (full),
+     `\*'           copyright sign (127),
+     `\\'           backslash,
+     `\{N}'         character of code `N' (decimal or hexadecimal).
+   A program is listed back by lines in the same form, so the text is
+   tokenized into the same program (except spaces around keywords and visible
+   text of numbers which differs from their hidden form). */
+
+#define BASTOK_FIRST_KEYWORD    0xA5    /* code of the first keyword (`RND') */
+
+/* Maximal length of text made by `bastok_list_line()' of a line of `n' bytes */
+#define BASTOK_MAX_TEXT_LEN(n)  (6 + 12 * (n))
+
+/* Maximal length of text made by `bastok_list_string()' of `n' characters
+   (with ending zero) */
+#define BASTOK_MAX_STRING_LEN(n)    (1 + 6 * (n))
+
+/* Error codes */
+#define BASTOK_OK               0
+#define BASTOK_ERR_LINE_NUMBER  1   /* line does not start with a valid number */
+#define BASTOK_ERR_LINE_ORDER   2   /* line numbers are not ascending */
+#define BASTOK_ERR_NUMBER       3   /* number is out of range */
+#define BASTOK_ERR_ESCAPE       4   /* invalid escape sequence */
+#define BASTOK_ERR_TOO_LONG     5   /* program is too long */
+
+const char *bastok_strerror (int err);
+const char *bastok_get_keyword (unsigned char code);
+int bastok_tokenize (char *dest, unsigned int capacity, const char *src,
+    unsigned long len, unsigned int *size, unsigned long *err_line);
+unsigned int bastok_list_line (char *dest, const char *src, unsigned int len,
+    unsigned int *size);
+unsigned int bastok_list_string (char *dest, const char *src, unsigned int len);
+int bastok_read_string (char *dest, unsigned int capacity, const char *src,
+    unsigned int len, unsigned int *size);
+
+#endif  /* !_bastok_h */
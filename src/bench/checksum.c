@@ -0,0 +1,112 @@
+/* checksum.c - benchmark of tape block checksum kernels.
+
+   `bench/checksum.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "checksum.h"
+
+/* Bytes checksummed by every kernel for each block size */
+#define TOTAL_LEN   (256UL << 20)
+
+/* Block sizes of real tapes: header, small `Program', screen, the largest
+   `Bytes' block */
+static const unsigned long sizes[] = { 19, 256, 6914, 49154 };
+
+#define SIZES (sizeof (sizes) / sizeof (sizes[0]))
+#define MAX_LEN 49154
+
+static double get_time (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Returns MB/s of `proc' over blocks of `len' bytes of `data' and XOR of all
+   checksums in `sum' */
+static double measure (char (*proc) (char, const char *, unsigned long),
+    const char *data, unsigned long len, char *sum)
+{
+    unsigned long i, count = TOTAL_LEN / len;
+    double start;
+    char x = 0;
+
+    start = get_time ();
+    /* the checksum of the previous block is passed on, so no call is skipped */
+    for (i = 0; i < count; i++)
+        x = proc (x, data, len);
+    *sum = x;
+    return count * len / (get_time () - start) / 1e6;
+}
+
+/* Checks the selected kernel against the scalar one on all lengths and
+   alignments of short data and on random lengths of long data */
+static char check (const char *data)
+{
+    unsigned long len, offset, n;
+
+    for (len = 0; len <= 256; len++)
+        for (offset = 0; offset < 32; offset++)
+            if (xor_checksum (0x5A, data + offset, len)
+            !=  xor_checksum_scalar (0x5A, data + offset, len))
+                return 1;
+    for (n = 0; n < 1000; n++)
+    {
+        offset = rand () % 64;
+        len = rand () % (MAX_LEN - 64);
+        if (xor_checksum (0, data + offset, len) != xor_checksum_scalar (0, data + offset, len))
+            return 1;
+    }
+    return 0;
+}
+
+int main (void)
+{
+    char *data;
+    unsigned long i;
+    double scalar, fast;
+    char a, b;
+
+    data = malloc (MAX_LEN);
+    if (!data)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+    srand (1);
+    for (i = 0; i < MAX_LEN; i++)
+        data[i] = rand ();
+
+    if (check (data))
+    {
+        fprintf (stderr, "Checksum `%s' differs from scalar one!\n", xor_checksum_impl ());
+        free (data);
+        return 1;
+    }
+
+    printf ("checksum: `%s' vs scalar, %lu MB per size\n", xor_checksum_impl (), TOTAL_LEN >> 20);
+    printf ("%8s %12s %12s %8s\n", "block", "scalar MB/s", "fast MB/s", "speedup");
+    for (i = 0; i < SIZES; i++)
+    {
+        scalar = measure (xor_checksum_scalar, data, sizes[i], &a);
+        fast = measure (xor_checksum, data, sizes[i], &b);
+        if (a != b)
+        {
+            fprintf (stderr, "Checksums of %lu bytes blocks differ!\n", sizes[i]);
+            free (data);
+            return 1;
+        }
+        printf ("%8lu %12.0f %12.0f %7.1fx\n", sizes[i], scalar, fast, fast / scalar);
+    }
+    free (data);
+    return 0;
+}
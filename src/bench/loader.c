@@ -0,0 +1,189 @@
+/* loader.c - benchmark of BASIC loader generation.
+
+   `bench/loader.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "basic.h"
+#include "tapfile.h"
+#include "libbintap.h"
+
+/* Loaders made by each way for every configuration in one round, the fastest
+   of `ROUNDS' rounds is taken */
+#define COUNT   100000
+#define ROUNDS  5
+
+/* Settings which change the loader */
+struct setup_t
+{
+    const char *name;
+    char d80_syntax;
+    char print_headers;
+    char fast_numbers;
+    unsigned int clear_address;
+    unsigned int exec_address;
+    unsigned int blocks;
+};
+
+static const struct setup_t setups[] =
+{
+    { "default",    0, 1, 0, 24575, 32768, 1 },
+    { "nph-d80",    1, 0, 0, 25000, 25000, 1 },
+    { "fast-4blk",  0, 1, 1, 23999, 24000, 4 },
+    { "32 blocks",  0, 1, 0, 24575, 24576, BINTAP_MAX_CHUNKS }
+};
+
+#define SETUPS (sizeof (setups) / sizeof (setups[0]))
+
+static double get_time (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Makes the same loader as `make_loader()' of `libbintap.c' (without turbo
+   loader) the old way: token by token with `BASPROG' */
+static unsigned int make_tokens (const struct bintap_config_t *cfg, char *name,
+    unsigned int blocks, char *buf)
+{
+    char cost = cfg->fast_numbers ? BAS_COST_TIME : BAS_COST_SIZE;
+    BASPROG p;
+    unsigned int i;
+
+    bas_start (&p, buf, BINTAP_LINE_START, BINTAP_LINE_INC);
+    bas_new_line (&p);
+    bas_put_ascii (&p, SYM_REM "loader by " BINTAP_NAME "-" BINTAP_VERSION);
+    bas_new_line (&p);
+    bas_put_char (&p, LEX_BORDER);
+    bas_put_int_best (&p, cfg->border_color, cost);
+    bas_put_ascii (&p, ":" SYM_PAPER);
+    bas_put_int_best (&p, cfg->paper_color, cost);
+    bas_put_ascii (&p, ":" SYM_INK);
+    bas_put_int_best (&p, cfg->ink_color, cost);
+    bas_put_ascii (&p, ":" SYM_BRIGHT);
+    bas_put_int_best (&p, 0, cost);
+    bas_put_ascii (&p, ":" SYM_FLASH);
+    bas_put_int_best (&p, 0, cost);
+    bas_put_ascii (&p, ":" SYM_INVERSE);
+    bas_put_int_best (&p, 0, cost);
+    bas_put_ascii (&p, ":" SYM_CLS);
+    bas_new_line (&p);
+    bas_put_char (&p, LEX_CLEAR);
+    bas_put_int_best (&p, cfg->clear_address, cost);
+    if (!cfg->print_headers)
+    {
+        bas_new_line (&p);
+        bas_put_char (&p, LEX_POKE);
+        bas_put_int_best (&p, 23739, cost);
+        bas_put_char (&p, ',');
+        bas_put_int_best (&p, 111, cost);
+    }
+    bas_new_line (&p);
+    for (i = 0; i < blocks; i++)
+    {
+        if (i)
+            bas_put_char (&p, ':');
+        bas_put_char (&p, LEX_LOAD);
+        if (cfg->d80_syntax)
+            bas_put_char (&p, '*');
+        bas_put_char (&p, '"');
+        bas_put_ascii (&p, name);
+        bas_put_ascii (&p, "\"" SYM_CODE);
+    }
+    bas_new_line (&p);
+    bas_put_ascii (&p, SYM_RANDOMIZE SYM_USR);
+    bas_put_int_best (&p, cfg->exec_address, cost);
+    bas_end (&p);
+    return bas_get_size (&p);
+}
+
+/* Puts the loader made the old way into `tape' as `bintap_put_loader()' does */
+static void put_tokens (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, unsigned int blocks)
+{
+    char buf[BINTAP_MAX_LOADER_LEN];
+    unsigned int len;
+
+    len = make_tokens (cfg, name, blocks, buf);
+    tap_new_block (tape);
+    tap_put_char (tape, TAP_BLK_HEADER);
+    tap_put_program_header (tape, name, len, BINTAP_LINE_RUN, len);
+    tap_end_block (tape);
+    tap_new_block (tape);
+    tap_put_char (tape, TAP_BLK_DATA);
+    tap_put_data (tape, buf, len);
+    tap_end (tape);
+}
+
+int main (void)
+{
+    static char old[BINTAP_MAX_TAPE_LEN (0)], new[BINTAP_MAX_TAPE_LEN (0)];
+    struct bintap_config_t cfg;
+    TAPFILE tape;
+    char name[] = "game";
+    unsigned int i, k, r, old_size, new_size;
+    double start, time, old_time, new_time;
+
+    printf ("loader: prebuilt parts vs token by token, best of %u rounds of %u loaders\n",
+        ROUNDS, COUNT);
+    printf ("%-10s %6s %14s %14s %8s\n", "setup", "bytes", "tokens/s", "parts/s", "speedup");
+    for (k = 0; k < SETUPS; k++)
+    {
+        bintap_init_config (&cfg);
+        cfg.basic = 1;
+        cfg.d80_syntax = setups[k].d80_syntax;
+        cfg.print_headers = setups[k].print_headers;
+        cfg.fast_numbers = setups[k].fast_numbers;
+        cfg.clear_address = setups[k].clear_address;
+        cfg.exec_address = setups[k].exec_address;
+        cfg.border_color = k;
+
+        old_time = new_time = 0;
+        for (r = 0; r < ROUNDS; r++)
+        {
+            start = get_time ();
+            for (i = 0; i < COUNT; i++)
+            {
+                tap_start (&tape, old, sizeof (old));
+                put_tokens (&tape, &cfg, name, setups[k].blocks);
+            }
+            time = get_time () - start;
+            if (!r || time < old_time)
+                old_time = time;
+            old_size = tap_get_size (&tape);
+
+            start = get_time ();
+            for (i = 0; i < COUNT; i++)
+            {
+                tap_start (&tape, new, sizeof (new));
+                if (bintap_put_loader (&tape, &cfg, name, name, setups[k].blocks))
+                {
+                    fprintf (stderr, "Failed to make loader `%s'!\n", setups[k].name);
+                    return 1;
+                }
+            }
+            time = get_time () - start;
+            if (!r || time < new_time)
+                new_time = time;
+            new_size = tap_get_size (&tape);
+        }
+
+        if (tap_get_error (&tape) || old_size != new_size || memcmp (old, new, new_size))
+        {
+            fprintf (stderr, "Loaders `%s' made both ways differ!\n", setups[k].name);
+            return 1;
+        }
+        printf ("%-10s %6u %14.0f %14.0f %7.2fx\n", setups[k].name, new_size,
+            COUNT / old_time, COUNT / new_time, old_time / new_time);
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+/* lzpack.c - benchmark of LZ packer.
+
+   `bench/lzpack.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lzpack.h"
+
+/* Every input is packed again for at least this time */
+#define MIN_TIME    0.2
+
+/* Files packed when none are given (relative to `src' directory, the text
+   does not change) */
+static const char *const def_files[] = { "../LICENSE", NULL };
+
+static double get_time (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Unpacks stream `src' into `dest' of `size' bytes. Returns the unpacked
+   length or -1 on broken stream. */
+static long unpack (const unsigned char *src, unsigned long src_len,
+    unsigned char *dest, unsigned long size)
+{
+    unsigned long i = 0, o = 0, len, offset;
+    unsigned char t;
+
+    while (i < src_len)
+    {
+        t = src[i++];
+        if (!t)
+            return o;
+        if (t < 0x80)
+        {
+            if (i + t > src_len || o + t > size)
+                return -1;
+            memcpy (dest + o, src + i, t);
+            i += t;
+            o += t;
+            continue;
+        }
+        if (i + 2 > src_len)
+            return -1;
+        len = (t & 0x7F) + LZ_MIN_MATCH;
+        offset = src[i] + src[i + 1] * 256;
+        i += 2;
+        if (!offset || offset > o || o + len > size)
+            return -1;
+        /* overlapping copy repeats bytes */
+        for (; len; len--, o++)
+            dest[o] = dest[o - offset];
+    }
+    return -1;
+}
+
+/* Makes ZX Spectrum like screen: patterned pixels in a few colour areas */
+static void make_screen (char *p)
+{
+    unsigned int i;
+
+    for (i = 0; i < 6144; i++)
+        p[i] = (i / 32) % 64 < 24 ? 0 : (i & 0x100) ? 0xAA : 0x3C ^ (i % 7);
+    for (i = 0; i < 768; i++)
+        p[6144 + i] = i % 32 < 8 ? 0x07 : i / 32 < 12 ? 0x38 : 0x46;
+}
+
+static unsigned long seed;
+
+/* Returns the next pseudo random number (the same sequence in every run) */
+static unsigned int get_random (void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7FFF;
+}
+
+/* Fills `p' with `len' pseudo random bytes */
+static void make_random (char *p, unsigned int len)
+{
+    seed = 1;
+    while (len--)
+        *p++ = get_random ();
+}
+
+/* Fills `p' with `len' bytes like machine code or data: mostly short pieces
+   repeated from the last 4 KB and some random bytes between */
+static void make_mixed (char *p, unsigned int len)
+{
+    unsigned int i = 0, n, offset;
+
+    seed = 2;
+    while (i < len)
+    {
+        if (i < 64 || get_random () % 10 < 3)
+        {
+            p[i++] = get_random ();
+            continue;
+        }
+        n = 3 + get_random () % 16;
+        offset = 1 + get_random () % (i < 4096 ? i : 4096);
+        for (; n && i < len; n--, i++)
+            p[i] = p[i - offset];
+    }
+}
+
+/* Reads at most `LZ_MAX_LEN' bytes of file `name' into `p'. Returns its
+   length or -1. */
+static long read_file (const char *name, char *p)
+{
+    FILE *f;
+    long len;
+
+    f = fopen (name, "rb");
+    if (!f)
+        return -1;
+    len = fread (p, 1, LZ_MAX_LEN, f);
+    if (ferror (f))
+        len = -1;
+    fclose (f);
+    return len;
+}
+
+/* Packs `len' bytes of `data' named `name' repeatedly, checks the stream and
+   shows ratio and throughput. Adds lengths to totals. */
+static char bench (struct lz_work_t *work, const char *name, const char *data,
+    unsigned int len, char *buf, unsigned long *total_in, unsigned long *total_out,
+    double *total_time)
+{
+    unsigned int packed = 0, gap, count = 0;
+    double start, time;
+
+    start = get_time ();
+    do
+    {
+        packed = lz_pack (work, data, len, work->out, &gap);
+        count++;
+        time = get_time () - start;
+    } while (time < MIN_TIME);
+
+    if (!packed || unpack ((unsigned char *) work->out, packed,
+        (unsigned char *) buf, LZ_MAX_LEN) != len || memcmp (buf, data, len))
+    {
+        fprintf (stderr, "Packed stream of `%s' does not unpack to it!\n", name);
+        return 1;
+    }
+    printf ("%-12s %8u %8u %7.1f%% %10.2f\n", name, len, packed,
+        packed * 100.0 / len, (double) len * count / time / 1e6);
+    *total_in += len;
+    *total_out += packed;
+    *total_time += time / count;
+    return 0;
+}
+
+int main (int argc, char **argv)
+{
+    struct lz_work_t *work;
+    char *data, *buf;
+    const char *const *files;
+    unsigned long total_in = 0, total_out = 0;
+    double total_time = 0;
+    long len;
+    char err = 1;
+
+    work = malloc (sizeof (struct lz_work_t));
+    data = malloc (LZ_MAX_LEN);
+    buf = malloc (LZ_MAX_LEN);
+    if (!work || !data || !buf)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        goto error_exit;
+    }
+
+    printf ("lzpack: packed size and throughput, %u bytes of depacker not counted\n",
+        LZ_DEPACKER_LEN);
+    printf ("%-12s %8s %8s %8s %10s\n", "input", "size", "packed", "ratio", "MB/s");
+    memset (data, 0, LZ_MAX_LEN);
+    if (bench (work, "zeros", data, LZ_MAX_LEN, buf, &total_in, &total_out, &total_time))
+        goto error_exit;
+    make_screen (data);
+    if (bench (work, "screen", data, 6912, buf, &total_in, &total_out, &total_time))
+        goto error_exit;
+    make_mixed (data, LZ_MAX_LEN);
+    if (bench (work, "mixed", data, LZ_MAX_LEN, buf, &total_in, &total_out, &total_time))
+        goto error_exit;
+    make_random (data, LZ_MAX_LEN);
+    if (bench (work, "random", data, LZ_MAX_LEN, buf, &total_in, &total_out, &total_time))
+        goto error_exit;
+
+    /* files given by arguments or sources of the program */
+    files = argc > 1 ? (const char *const *) argv + 1 : def_files;
+    for (; *files; files++)
+    {
+        len = read_file (*files, data);
+        if (len <= 0)
+        {
+            fprintf (stderr, "Failed to read input file `%s'!\n", *files);
+            goto error_exit;
+        }
+        if (bench (work, *files, data, len, buf, &total_in, &total_out, &total_time))
+            goto error_exit;
+    }
+    printf ("%-12s %8lu %8lu %7.1f%% %10.2f\n", "total", total_in, total_out,
+        total_out * 100.0 / total_in, total_in / total_time / 1e6);
+    err = 0;
+
+error_exit:
+    free (work);
+    free (data);
+    free (buf);
+    return err;
+}
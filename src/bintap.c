@@ -12,15 +12,30 @@
 #include <string.h>
 #include <libgen.h>
 #include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include "opts.h"
 #include "tapfile.h"
-#include "basic.h"
+#include "tzxfile.h"
+#include "turbo.h"
+#include "bastok.h"
+#include "wavfile.h"
+#include "libbintap.h"
+#include "tapindex.h"
+#include "checksum.h"
+#include "jobs.h"
+#include "cache.h"
+#include "manifest.h"
 
-#define PROGRAM_NAME    "bintap"
-#define PROGRAM_VERSION "1.0"
+#define PROGRAM_NAME    BINTAP_NAME
+#define PROGRAM_VERSION BINTAP_VERSION
 
 #define PROGRAM_DESCRIPTION \
-"Binary to `.tap' tape file converter."
+"Binary to `.tap' or `.tzx' tape file converter."
 
 #define PROGRAM_LICENSE \
 "License: public domain, <http://unlicense.org>\n\
@@ -34,36 +49,84 @@ There is NO WARRANTY, to the extent permitted by law."
 "Home page: <https://gitlab.com/ivan-tat/bintap>"
 
 /* Limits */
-#define MAX_LOADER_LEN      256
-#define MAX_DATA_LEN        49152
-#define MAX_LINE            9999
-#define MAX_ADDR            65535
-#define MAX_COL             7
+#define MAX_DATA_LEN        BINTAP_MAX_DATA_LEN
+#define MAX_LINE            BINTAP_MAX_LINE
+#define MAX_ADDR            BINTAP_MAX_ADDR
+#define MAX_COL             BINTAP_MAX_COL
 #define MAX_FILENAME_LEN    255
+#define MAX_BLOCK           65535
+#define MAX_TIMING          65535
+
+/* Input files are read by chunks of this size */
+#define CHUNK_LEN           16384
+
+/* `--watch' writes changed bytes of a tape closer than this at once */
+#define PATCH_GAP           64
 
 /* Default values */
 #define DEF_FILE_EXT    ".tap"
-#define DEF_START_LINE  32768
-#define DEF_LOAD_ADDR   32768
-#define DEF_EXTRA_ADDR  32768
-#define DEF_CLEAR_ADDR  24575
-#define DEF_EXEC_ADDR   32768
-#define DEF_BORDER_COL  0
-#define DEF_PAPER_COL   0
-#define DEF_INK_COL     7
-
-/* Internal BASIC loader generator */
-#define BAS_LINE_START  10
-#define BAS_LINE_INC    10
-#define BAS_LINE_RUN    20
+#define DEF_TZX_FILE_EXT ".tzx"
+#define DEF_WAV_FILE_EXT ".wav"
+#define DEF_START_LINE  BINTAP_DEF_START_LINE
+#define DEF_LOAD_ADDR   BINTAP_DEF_LOAD_ADDR
+#define DEF_EXTRA_ADDR  BINTAP_DEF_EXTRA_ADDR
+#define DEF_CLEAR_ADDR  BINTAP_DEF_CLEAR_ADDR
+#define DEF_EXEC_ADDR   BINTAP_DEF_EXEC_ADDR
+#define DEF_BORDER_COL  BINTAP_DEF_BORDER_COL
+#define DEF_PAPER_COL   BINTAP_DEF_PAPER_COL
+#define DEF_INK_COL     BINTAP_DEF_INK_COL
+#define NO_BLOCK        ((unsigned int) -1)
+#define NO_VALUE        (-1L)
+
+/* Blocks `first' to `last' (descending if `first' is greater) */
+struct block_range_t
+{
+    unsigned int first;
+    unsigned int last;
+};
+
+struct block_list_t
+{
+    struct block_range_t *ranges;
+    unsigned int count;
+};
+
+/* New fields of a header block (`NULL' or `NO_VALUE' to keep) */
+struct header_edit_t
+{
+    unsigned int block;
+    char *title;
+    long param1;
+    long param2;
+};
 
 /* General options */
 /* Flags */
 char            opt_program         = 0;
+char            opt_tokenize        = 0;
 char            opt_append          = 0;
 char            opt_auto_name       = 0;
+char            opt_stats           = 0;
+char            opt_watch           = 0;
 /* Values */
-char           *opt_input           = NULL;
+unsigned int    opt_jobs            = 1;
+unsigned int    opt_append_at       = NO_BLOCK;
+unsigned int    opt_chunk_size      = 0;
+unsigned int    opt_chunk_address[BINTAP_MAX_CHUNKS];
+unsigned int    opt_chunk_addresses = 0;    /* number of items in `opt_chunk_address' */
+char            opt_compress        = 0;
+char            opt_tzx             = 0;
+char            opt_turbo           = 0;
+char            opt_wav             = 0;
+unsigned int    opt_wav_rate        = WAV_DEF_RATE;
+struct tzx_timing_t opt_timing      =
+{
+    TZX_ROM_PILOT, TZX_ROM_SYNC1, TZX_ROM_SYNC2, TZX_ROM_ZERO, TZX_ROM_ONE,
+    TZX_ROM_DATA_PULSES, TZX_DEF_PAUSE
+};
+char           *opt_input_list      = NULL;
+char           *opt_manifest        = NULL;
+char           *opt_cache_dir       = NULL;
 char           *opt_output          = NULL;
 char           *opt_title           = NULL;
 unsigned int    opt_start_line      = DEF_START_LINE;
@@ -75,12 +138,49 @@ unsigned int    opt_extra_address   = DEF_EXTRA_ADDR;
 char            opt_basic           = 0;
 char            opt_d80_syntax      = 0;
 char            opt_print_headers   = 1;
+char            opt_fast_numbers    = 0;
+char            opt_attrs_first     = 0;
+char            opt_pack_screen     = 0;
 /* Values */
 unsigned int    opt_clear_address   = DEF_CLEAR_ADDR;
 unsigned int    opt_exec_address    = DEF_EXEC_ADDR;
 char            opt_border_color    = DEF_BORDER_COL;
 char            opt_paper_color     = DEF_PAPER_COL;
 char            opt_ink_color       = DEF_INK_COL;
+char           *opt_screen          = NULL;
+
+/* Tape inspection options */
+/* Flags */
+char            opt_list            = 0;
+char            opt_info            = 0;
+char            opt_detokenize      = 0;
+char            opt_extract         = 0;
+char            opt_verify          = 0;
+char            opt_repair          = 0;
+/* Values */
+unsigned int    opt_block           = NO_BLOCK;
+
+/* Tape editing options */
+/* Flags */
+char            opt_merge           = 0;
+/* Values */
+unsigned int    opt_insert_at       = NO_BLOCK;
+struct block_list_t opt_blocks      = { NULL, 0 };
+struct block_list_t opt_delete      = { NULL, 0 };
+struct header_edit_t opt_set_header = { NO_BLOCK, NULL, NO_VALUE, NO_VALUE };
+
+/* File mode creation mask read once as `umask()' can not just be queried */
+mode_t          file_umask          = 0;
+
+/* Input files */
+char          **inputs              = NULL;
+unsigned int    inputs_count        = 0;
+unsigned int    inputs_size         = 0;
+char            inputs_owned        = 0;    /* names were allocated by us */
+
+/* Screen loaded by BASIC loader */
+char            screen_data[BINTAP_SCREEN_LEN];
+struct lz_work_t *screen_lz         = NULL;     /* holds packed screen */
 
 #define HELP_HINT "Use `-h' to get help."
 
@@ -108,19 +208,34 @@ void show_help (void)
 "\n\
 " PROGRAM_NAME " - %s\n\
 \n\
-Usage: " PROGRAM_NAME " [OPTIONS] INPUT_FILE\n\
+Usage: " PROGRAM_NAME " [OPTIONS] INPUT_FILE...\n\
 \n\
 Options:\n\
   -h, --help                            show this help and exit.\n\
       --version                         show version and exit.\n\
   -p, --program                         make `Program' instead of `Bytes' [%c].\n\
+  -T, --tokenize                        make `Program' of BASIC text [%c].\n\
   -t TITLE, --title TITLE               set header name for all blocks.\n\
   -s LINE, --start-line LINE            BASIC start line for program [%u].\n\
   -o FILENAME, --output FILENAME        set output filename.\n\
       --auto-name                       make output filename from input [%c].\n\
   -a, --append                          append tape at end of file [%c].\n\
+      --append-at INDEX                 append tape replacing blocks from INDEX on.\n\
+  -i FILENAME, --input-list FILENAME    read input filenames from a file (`-' is stdin).\n\
+  -m FILENAME, --manifest FILENAME      make tape of blocks described in a file.\n\
+      --stats                           show conversion throughput [%c].\n\
+      --cache-dir DIR                   reuse output files cached in DIR.\n\
+      --watch                           convert input files again when they change [%c].\n\
+  -j N, --jobs N                        convert input files using N threads [%u].\n\
   -l ADDRESS, --load-address ADDRESS    load address of a binary file [%u].\n\
   -x ADDRESS, --extra-address ADDRESS   extra address of a binary file [%u].\n\
+      --chunk-size SIZE                 split data into blocks of SIZE bytes.\n\
+      --chunk-addresses LIST            load addresses of blocks (comma separated, 0 - default).\n\
+  -z, --compress                        pack data to unpack it at load address [%c].\n\
+      --tzx                             make `.tzx' tape instead of `.tap' [%c].\n\
+      --turbo TIMINGS                   make turbo speed data blocks in `.tzx' tape.\n\
+      --wav                             render tape into `.wav' file [%c].\n\
+      --wav-rate RATE                   sample rate of `.wav' file [%u].\n\
 \n\
 BASIC loader options:\n\
   -b, --basic                           include BASIC loader [%c].\n\
@@ -131,20 +246,67 @@ BASIC loader options:\n\
       --pc COLOR, --paper-color COLOR   set paper color [%u].\n\
       --ic COLOR, --ink-color COLOR     set ink color [%u].\n\
       --nph, --no-print-headers         hide header title when loading [%c].\n\
+      --fast-numbers                    make numbers fast to interpret, not short [%c].\n\
+      --screen FILENAME                 load screen of a file before the data.\n\
+      --attrs-first                     load attributes of screen before pixels [%c].\n\
+      --pack-screen                     pack screen to unpack it by loader [%c].\n\
+\n\
+Tape inspection options (input files are tapes):\n\
+  -L, --list                            list blocks of tape [%c].\n\
+      --info                            show summary of tape [%c].\n\
+  -D, --detokenize                      list BASIC programs of tape [%c].\n\
+  -X, --extract                         write `Bytes' blocks of tape into files [%c].\n\
+      --verify                          check blocks of tapes [%c].\n\
+      --repair                          check tapes and fix checksums and tails [%c].\n\
+      --block INDEX                     process only block INDEX.\n\
+\n\
+Tape editing options (input files are tapes joined into output tape):\n\
+  -M, --merge                           join input tapes [%c].\n\
+      --insert-at INDEX                 insert other tapes before block INDEX of the first.\n\
+      --blocks LIST                     keep only blocks of LIST in its order.\n\
+      --delete LIST                     remove blocks of LIST.\n\
+      --set-header HEADER               change fields of a header block.\n\
 \n\
-Maximum supported input file size is %u bytes.\n\
+Maximum supported input file size is %u bytes (or %u blocks of `SIZE').\n\
 Maximum `TITLE' length is %u.\n\
 `LINE' is a number in range [0; %u].\n\
 `ADDRESS' is a number in range [0; %u].\n\
+`SIZE' is a number in range [1; %u].\n\
 `COLOR' is a number in range [0; %u].\n\
-All numbers are decimal or hexadecimal (prefixed with `0x' or `0X').\n",
+`N' is a number in range [1; %u].\n\
+`RATE' is a number in range [%u; %u].\n\
+`INDEX' is a number in range [0; %u].\n\
+`LIST' is a comma separated list of INDEX or INDEX-INDEX ranges (reversed if\n\
+the first INDEX is greater) of blocks of joined tape.\n\
+`HEADER' is INDEX,TITLE[,PARAM1[,PARAM2]] (empty fields are kept), PARAM1 is\n\
+load address or start line, PARAM2 is extra address or program length.\n\
+Screen file is %u bytes long (pixels followed by attributes).\n\
+`TIMINGS' is a comma separated list PILOT,SYNC1,SYNC2,ZERO,ONE[,PULSES[,PAUSE]]\n\
+of pulse lengths in T-states, number of pilot pulses and pause in ms\n\
+(ROM loader: %u,%u,%u,%u,%u,%u,%u), each in range [1; %u] (PAUSE from 0).\n\
+BASIC loader of turbo speed blocks needs ROM PILOT, SYNC1, SYNC2 and at least\n\
+%u PULSES.\n\
+All numbers are decimal or hexadecimal (prefixed with `0x' or `0X').\n\
+\n\
+Several input files are converted in one run. With `--auto-name' each of them\n\
+gets its own output file, otherwise all of them are joined into one tape.\n\
+An output file is replaced only when its tape is made, an appended tape is\n\
+cut back on failure.\n",
         PROGRAM_DESCRIPTION,
         Y_or_N (opt_program),
+        Y_or_N (opt_tokenize),
         opt_start_line,
         Y_or_N (opt_auto_name),
         Y_or_N (opt_append),
+        Y_or_N (opt_stats),
+        Y_or_N (opt_watch),
+        opt_jobs,
         opt_load_address,
         opt_extra_address,
+        Y_or_N (opt_compress),
+        Y_or_N (opt_tzx),
+        Y_or_N (opt_wav),
+        opt_wav_rate,
         Y_or_N (opt_basic),
         Y_or_N (opt_d80_syntax),
         opt_clear_address,
@@ -153,11 +315,32 @@ All numbers are decimal or hexadecimal (prefixed with `0x' or `0X').\n",
         opt_paper_color,
         opt_ink_color,
         Y_or_N (!opt_print_headers),
+        Y_or_N (opt_fast_numbers),
+        Y_or_N (opt_attrs_first),
+        Y_or_N (opt_pack_screen),
+        Y_or_N (opt_list),
+        Y_or_N (opt_info),
+        Y_or_N (opt_detokenize),
+        Y_or_N (opt_extract),
+        Y_or_N (opt_verify),
+        Y_or_N (opt_repair),
+        Y_or_N (opt_merge),
         MAX_DATA_LEN,
+        BINTAP_MAX_CHUNKS,
         TAP_HEADER_NAME_LEN,
         MAX_LINE,
         MAX_ADDR,
-        MAX_COL);
+        MAX_DATA_LEN,
+        MAX_COL,
+        MAX_WORKERS,
+        WAV_MIN_RATE,
+        WAV_MAX_RATE,
+        MAX_BLOCK,
+        BINTAP_SCREEN_LEN,
+        TZX_ROM_PILOT, TZX_ROM_SYNC1, TZX_ROM_SYNC2, TZX_ROM_ZERO, TZX_ROM_ONE,
+        TZX_ROM_DATA_PULSES, TZX_DEF_PAUSE,
+        MAX_TIMING,
+        TURBO_MIN_PULSES);
 }
 
 int cmd_help (struct setopt_param_t *p)
@@ -196,6 +379,168 @@ int setopt_address (struct setopt_param_t *p)
     return optval_uint (p->long_form, p->name, optarg, (unsigned int *) p->var, 0, MAX_ADDR);
 }
 
+int setopt_jobs (struct setopt_param_t *p)
+{
+    return optval_uint (p->long_form, p->name, optarg, (unsigned int *) p->var, 1, MAX_WORKERS);
+}
+
+int setopt_size (struct setopt_param_t *p)
+{
+    return optval_uint (p->long_form, p->name, optarg, (unsigned int *) p->var, 1, MAX_DATA_LEN);
+}
+
+int setopt_address_list (struct setopt_param_t *p)
+{
+    char *s, *next;
+
+    opt_chunk_addresses = 0;
+    for (s = optarg; s; s = next)
+    {
+        next = strchr (s, ',');
+        if (next)
+            *(next++) = '\0';
+        if (opt_chunk_addresses == BINTAP_MAX_CHUNKS)
+        {
+            fprintf (stderr, "Too many addresses for option `%s%s'! Maximum is %u.\n",
+                p->long_form ? "--" : "-", p->name, BINTAP_MAX_CHUNKS);
+            return 1;
+        }
+        if (optval_uint (p->long_form, p->name, s,
+            &((unsigned int *) p->var)[opt_chunk_addresses], 0, MAX_ADDR))
+            return 1;
+        opt_chunk_addresses++;
+    }
+    return 0;
+}
+
+/* Sets `opt_turbo' and timings listed in order of fields of `tzx_timing_t' */
+int setopt_timing_list (struct setopt_param_t *p)
+{
+    unsigned int *timing[] =
+    {
+        &opt_timing.pilot, &opt_timing.sync1, &opt_timing.sync2,
+        &opt_timing.zero, &opt_timing.one, &opt_timing.pulses, &opt_timing.pause
+    };
+    unsigned int n = 0;
+    char *s, *next;
+
+    for (s = optarg; s; s = next)
+    {
+        next = strchr (s, ',');
+        if (next)
+            *(next++) = '\0';
+        if (n == sizeof (timing) / sizeof (timing[0]))
+        {
+            fprintf (stderr, "Too many values for option `%s%s'! Maximum is %u.\n",
+                p->long_form ? "--" : "-", p->name, n);
+            return 1;
+        }
+        /* pause may be zero */
+        if (optval_uint (p->long_form, p->name, s, timing[n], timing[n] != &opt_timing.pause,
+            MAX_TIMING))
+            return 1;
+        n++;
+    }
+    if (n < 5)
+    {
+        fprintf (stderr, "Too few values for option `%s%s'! Minimum is 5.\n",
+            p->long_form ? "--" : "-", p->name);
+        return 1;
+    }
+    opt_turbo = 1;
+    return 0;
+}
+
+int setopt_rate (struct setopt_param_t *p)
+{
+    return optval_uint (p->long_form, p->name, optarg, (unsigned int *) p->var,
+        WAV_MIN_RATE, WAV_MAX_RATE);
+}
+
+int setopt_block (struct setopt_param_t *p)
+{
+    return optval_uint (p->long_form, p->name, optarg, (unsigned int *) p->var, 0, MAX_BLOCK);
+}
+
+/* Sets block list of INDEX or INDEX-INDEX items separated by commas */
+int setopt_block_list (struct setopt_param_t *p)
+{
+    struct block_list_t *list = p->var;
+    struct block_range_t *r;
+    char *s, *next, *last;
+
+    for (s = optarg; s; s = next)
+    {
+        next = strchr (s, ',');
+        if (next)
+            *(next++) = '\0';
+        last = strchr (s, '-');
+        if (last)
+            *(last++) = '\0';
+        r = realloc (list->ranges, sizeof (struct block_range_t) * (list->count + 1));
+        if (!r)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            return 1;
+        }
+        list->ranges = r;
+        r += list->count;
+        if (optval_uint (p->long_form, p->name, s, &r->first, 0, MAX_BLOCK))
+            return 1;
+        r->last = r->first;
+        if (last && optval_uint (p->long_form, p->name, last, &r->last, 0, MAX_BLOCK))
+            return 1;
+        list->count++;
+    }
+    return 0;
+}
+
+/* Sets header block edit of INDEX,TITLE[,PARAM1[,PARAM2]] form */
+int setopt_header (struct setopt_param_t *p)
+{
+    struct header_edit_t *h = p->var;
+    unsigned int value;
+    char *s[4], *next;
+    unsigned int n = 0;
+
+    for (next = optarg; next && n < 4; n++)
+    {
+        s[n] = next;
+        next = strchr (next, ',');
+        if (next)
+            *(next++) = '\0';
+    }
+    if (n < 2 || next)
+    {
+        fprintf (stderr, "Option `%s%s' needs 2 to 4 values!\n",
+            p->long_form ? "--" : "-", p->name);
+        return 1;
+    }
+    if (optval_uint (p->long_form, p->name, s[0], &h->block, 0, MAX_BLOCK))
+        return 1;
+    if (strlen (s[1]) > TAP_HEADER_NAME_LEN)
+    {
+        fprintf (stderr, "Title of option `%s%s' is too long! Maximum is %u.\n",
+            p->long_form ? "--" : "-", p->name, TAP_HEADER_NAME_LEN);
+        return 1;
+    }
+    h->title = *s[1] ? s[1] : NULL;
+    h->param1 = h->param2 = NO_VALUE;
+    if (n > 2 && *s[2])
+    {
+        if (optval_uint (p->long_form, p->name, s[2], &value, 0, MAX_ADDR))
+            return 1;
+        h->param1 = value;
+    }
+    if (n > 3 && *s[3])
+    {
+        if (optval_uint (p->long_form, p->name, s[3], &value, 0, MAX_ADDR))
+            return 1;
+        h->param2 = value;
+    }
+    return 0;
+}
+
 int setopt_color (struct setopt_param_t *p)
 {
     return optval_char (p->long_form, p->name, optarg, (char *) p->var, 0, MAX_COL);
@@ -206,13 +551,28 @@ const struct ext_option_t ext_options[] =
     { 'h',  "help",             no_argument,        cmd_help,           NULL, 0 },
     { 0,    "version",          no_argument,        cmd_version,        NULL, 0 },
     { 'p',  "program",          no_argument,        setopt_char,        &opt_program, 1 },
+    { 'T',  "tokenize",         no_argument,        setopt_char,        &opt_tokenize, 1 },
     { 't',  "title",            required_argument,  setopt_string,      &opt_title, 0 },
     { 's',  "start-line",       required_argument,  setopt_line,        &opt_start_line, 0 },
     { 'o',  "output",           required_argument,  setopt_string,      &opt_output, 0 },
     { 0,    "auto-name",        no_argument,        setopt_char,        &opt_auto_name, 1 },
     { 'a',  "append",           no_argument,        setopt_char,        &opt_append, 1 },
+    { 0,    "append-at",        required_argument,  setopt_block,       &opt_append_at, 0 },
+    { 'i',  "input-list",       required_argument,  setopt_string,      &opt_input_list, 0 },
+    { 'm',  "manifest",         required_argument,  setopt_string,      &opt_manifest, 0 },
+    { 0,    "stats",            no_argument,        setopt_char,        &opt_stats, 1 },
+    { 0,    "cache-dir",        required_argument,  setopt_string,      &opt_cache_dir, 0 },
+    { 0,    "watch",            no_argument,        setopt_char,        &opt_watch, 1 },
+    { 'j',  "jobs",             required_argument,  setopt_jobs,        &opt_jobs, 0 },
     { 'l',  "load-address",     required_argument,  setopt_address,     &opt_load_address, 0 },
     { 'x',  "extra-address",    required_argument,  setopt_address,     &opt_extra_address, 0 },
+    { 0,    "chunk-size",       required_argument,  setopt_size,        &opt_chunk_size, 0 },
+    { 0,    "chunk-addresses",  required_argument,  setopt_address_list, opt_chunk_address, 0 },
+    { 'z',  "compress",         no_argument,        setopt_char,        &opt_compress, 1 },
+    { 0,    "tzx",              no_argument,        setopt_char,        &opt_tzx, 1 },
+    { 0,    "turbo",            required_argument,  setopt_timing_list, NULL, 0 },
+    { 0,    "wav",              no_argument,        setopt_char,        &opt_wav, 1 },
+    { 0,    "wav-rate",         required_argument,  setopt_rate,        &opt_wav_rate, 0 },
     { 'b',  "basic",            no_argument,        setopt_char,        &opt_basic, 1 },
     { 'd',  "d80",              no_argument,        setopt_char,        &opt_d80_syntax, 1 },
     { 'c',  "clear-address",    required_argument,  setopt_address,     &opt_clear_address, 0 },
@@ -225,6 +585,22 @@ const struct ext_option_t ext_options[] =
     { 0,    "ink-color",        required_argument,  setopt_color,       &opt_ink_color, 0 },
     { 0,    "nph",              no_argument,        setopt_char,        &opt_print_headers, 0 },
     { 0,    "no-print-headers", no_argument,        setopt_char,        &opt_print_headers, 0 },
+    { 0,    "fast-numbers",     no_argument,        setopt_char,        &opt_fast_numbers, 1 },
+    { 0,    "screen",           required_argument,  setopt_string,      &opt_screen, 0 },
+    { 0,    "attrs-first",      no_argument,        setopt_char,        &opt_attrs_first, 1 },
+    { 0,    "pack-screen",      no_argument,        setopt_char,        &opt_pack_screen, 1 },
+    { 'L',  "list",             no_argument,        setopt_char,        &opt_list, 1 },
+    { 0,    "info",             no_argument,        setopt_char,        &opt_info, 1 },
+    { 'D',  "detokenize",       no_argument,        setopt_char,        &opt_detokenize, 1 },
+    { 'X',  "extract",          no_argument,        setopt_char,        &opt_extract, 1 },
+    { 0,    "verify",           no_argument,        setopt_char,        &opt_verify, 1 },
+    { 0,    "repair",           no_argument,        setopt_char,        &opt_repair, 1 },
+    { 0,    "block",            required_argument,  setopt_block,       &opt_block, 0 },
+    { 'M',  "merge",            no_argument,        setopt_char,        &opt_merge, 1 },
+    { 0,    "insert-at",        required_argument,  setopt_block,       &opt_insert_at, 0 },
+    { 0,    "blocks",           required_argument,  setopt_block_list,  &opt_blocks, 0 },
+    { 0,    "delete",           required_argument,  setopt_block_list,  &opt_delete, 0 },
+    { 0,    "set-header",       required_argument,  setopt_header,      &opt_set_header, 0 },
     { 0, NULL, 0, NULL, NULL, 0 }   /* end mark */
 };
 
@@ -270,171 +646,234 @@ void get_tape_header_name (char *dest, char *src)
     }
 }
 
-void put_loader (TAPFILE *tape, char *basic_name, char *data_name)
+char add_input (char *name)
 {
-    BASPROG p;
-    char buf[MAX_LOADER_LEN];
-    unsigned int len;
+    char **p;
 
-    bas_start (&p, buf, BAS_LINE_START, BAS_LINE_INC);
-    bas_new_line (&p);
-    bas_put_ascii (&p, SYM_REM "loader by " PROGRAM_NAME "-" PROGRAM_VERSION);
-    bas_new_line (&p);
-    bas_put_char (&p, LEX_BORDER);
-    bas_put_int_compact (&p, opt_border_color);
-    bas_put_ascii (&p, ":" SYM_PAPER);
-    bas_put_int_compact (&p, opt_paper_color);
-    bas_put_ascii (&p, ":" SYM_INK);
-    bas_put_int_compact (&p, opt_ink_color);
-    bas_put_ascii (&p, ":" SYM_BRIGHT);
-    bas_put_int_compact (&p, 0);
-    bas_put_ascii (&p, ":" SYM_FLASH);
-    bas_put_int_compact (&p, 0);
-    bas_put_ascii (&p, ":" SYM_INVERSE);
-    bas_put_int_compact (&p, 0);
-    bas_put_ascii (&p, ":" SYM_CLS);
-    bas_new_line (&p);
-    bas_put_char (&p, LEX_CLEAR);
-    bas_put_int_compact (&p, opt_clear_address);
-    if (!opt_print_headers)
-    {
-        bas_new_line (&p);
-        bas_put_char (&p, LEX_POKE);
-        bas_put_int_compact (&p, 23739);
-        bas_put_char (&p, ',');
-        bas_put_int_compact (&p, 111);
-    }
-    bas_new_line (&p);
-    bas_put_char (&p, LEX_LOAD);
-    if (opt_d80_syntax)
-        bas_put_char (&p, '*');
-    bas_put_char (&p, '"');
-    bas_put_ascii (&p, data_name);
-    bas_put_ascii (&p, "\"" SYM_CODE);
-    bas_new_line (&p);
-    bas_put_ascii (&p, SYM_RANDOMIZE SYM_USR);
-    bas_put_int_compact (&p, opt_exec_address);
-    bas_end (&p);
-
-    len = bas_get_size (&p);
-
-    /* new block */
-    tap_new_block (tape);
-    tap_put_char (tape, TAP_BLK_HEADER);
-    tap_put_program_header (tape, basic_name, len, BAS_LINE_RUN, len);
-    tap_end_block (tape);
-
-    /* new block */
-    tap_new_block (tape);
-    tap_put_char (tape, TAP_BLK_DATA);
-    tap_put_data (tape, buf, len);
-    tap_end (tape);
+    if (inputs_count == inputs_size)
+    {
+        p = realloc (inputs, sizeof (char *) * (inputs_size ? inputs_size * 2 : 16));
+        if (!p)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            return 1;
+        }
+        inputs = p;
+        inputs_size = inputs_size ? inputs_size * 2 : 16;
+    }
+    inputs[inputs_count++] = name;
+    return 0;
 }
 
-void shutdown (void)
+/* Reads input filenames from `filename' (one per line, `-' is stdin).
+   Empty lines and lines starting with `#' are skipped. */
+char read_input_list (const char *filename)
 {
-    free_opts (&shortopts, &longopts);
+    FILE *f;
+    char *line = NULL, *name;
+    size_t size = 0;
+    ssize_t len;
+    char err = 0;
+
+    if (!strcmp (filename, "-"))
+        f = stdin;
+    else
+    {
+        f = fopen (filename, "r");
+        if (!f)
+        {
+            fprintf (stderr, "Failed to open input list file `%s'!\n", filename);
+            return 1;
+        }
+    }
+
+    while (!err && (len = getline (&line, &size, f)) != -1)
+    {
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (!len || line[0] == '#')
+            continue;
+        name = strdup (line);
+        if (!name)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            err = 1;
+        }
+        else if (add_input (name))
+        {
+            free (name);
+            err = 1;
+        }
+    }
+    if (!err && ferror (f))
+    {
+        fprintf (stderr, "Failed to read input list file `%s'!\n", filename);
+        err = 1;
+    }
+
+    free (line);
+    if (f != stdin)
+        fclose (f);
+    return err;
 }
 
-int main (int argc, char **argv)
+void free_inputs (void)
 {
-    char inv_opt = 0, inv_val = 0;
-    int c, i;
-    char short_name[2];
-    const char *opt_name;
-    FILE *fi, *fo;
-    char *fi_basename;
-    unsigned int fi_size;
-    char fo_name[MAX_FILENAME_LEN];
-    char title[TAP_HEADER_NAME_LEN + 1];
-    char buf[(sizeof (struct tap_block_header_t) + 4) * 2 + MAX_LOADER_LEN + MAX_DATA_LEN];
-    TAPFILE tape;
+    unsigned int i;
 
-    atexit (shutdown);
+    if (inputs)
+    {
+        if (inputs_owned)
+            for (i = 0; i < inputs_count; i++)
+                free (inputs[i]);
+        free (inputs);
+        inputs = NULL;
+    }
+    inputs_count = 0;
+    inputs_size = 0;
+}
 
-    if (init_opts (ext_options, &shortopts, &longopts))
+double get_time (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void show_stats (const char *name, unsigned long in_size, unsigned long out_size,
+    unsigned long packed_size, char cached, double time)
+{
+    fprintf (stderr, "%s: %lu -> %lu bytes", name, in_size, out_size);
+    if (cached)
+        fprintf (stderr, " (cached)");
+    if (packed_size)
+        fprintf (stderr, " (packed to %lu, %.1f%%)",
+            packed_size, packed_size * 100.0 / in_size);
+    fprintf (stderr, ", %.3f ms, %.2f MB/s", time * 1e3, time > 0 ? in_size / time / 1e6 : 0.0);
+    /* 8-bit mono sample is 1 byte */
+    if (opt_wav && !cached)
+        fprintf (stderr, ", %.2f Msamples/s", time > 0 ? out_size / time / 1e6 : 0.0);
+    fprintf (stderr, "\n");
+}
+
+void get_config (struct bintap_config_t *cfg)
+{
+    unsigned int i;
+
+    bintap_init_config (cfg);
+    cfg->program = opt_program;
+    cfg->basic = opt_basic;
+    cfg->d80_syntax = opt_d80_syntax;
+    cfg->print_headers = opt_print_headers;
+    cfg->fast_numbers = opt_fast_numbers;
+    cfg->start_line = opt_start_line;
+    cfg->load_address = opt_load_address;
+    cfg->extra_address = opt_extra_address;
+    cfg->clear_address = opt_clear_address;
+    cfg->exec_address = opt_exec_address;
+    cfg->border_color = opt_border_color;
+    cfg->paper_color = opt_paper_color;
+    cfg->ink_color = opt_ink_color;
+    cfg->chunk_size = opt_chunk_size;
+    cfg->turbo = opt_turbo;
+    cfg->timing = opt_timing;
+    for (i = 0; i < opt_chunk_addresses; i++)
+        cfg->chunk_address[i] = opt_chunk_address[i];
+    /* the first block is loaded at load address (0 keeps `-l') */
+    if (opt_chunk_addresses && opt_chunk_address[0])
+        cfg->load_address = opt_chunk_address[0];
+    if (opt_screen)
     {
-        fprintf (stderr, "Failed to allocate memory!\n");
-        return 1;
+        cfg->screen = screen_data;
+        cfg->screen_size = BINTAP_SCREEN_LEN;
+        cfg->screen_layout = opt_attrs_first ? BINTAP_SCREEN_ATTRS : BINTAP_SCREEN_WHOLE;
     }
+}
 
-    if (argc > 1)
+char read_all (int fd, char *buf, unsigned int size)
+{
+    ssize_t len;
+
+    while (size)
     {
-        optind = 0; /* reset option index */
-        while (!inv_opt && !inv_val)
-        {
-            /* `shortopts' must be a valid ASCIZ string, not NULL */
-            c = getopt_long (argc, argv, shortopts, longopts, &i);
-            if (c == -1)    /* end of the options */
-                break;
-            switch (c)
-            {
-            case 0:
-                /* long option */
-                opt_name = longopts[i].name;
-                i = find_long_opt (ext_options, opt_name);
-                if (i == -1)
-                    fprintf (stderr, "getopt_long() returned unknown option `%s'!\n", opt_name);
-                else
-                    inv_val = set_opt (ext_options, 1, opt_name, i);
-                break;
-            case '?':
-                /* getopt_long() already printed an error message. */
-                short_name[0] = optopt;
-                short_name[1] = '\0';
-                opt_name = short_name;
-                inv_opt = 1;
-                break;
-            default:
-                /* short option */
-                short_name[0] = c;
-                short_name[1] = '\0';
-                opt_name = short_name;
-                i = find_short_opt (ext_options, c);
-                if (i == -1)
-                    fprintf (stderr, "getopt_long() returned unknown character `\\x%02hhX'!\n", c);
-                else
-                    inv_val = set_opt (ext_options, 0, opt_name, i);
-            }
-        }
-        if (inv_opt || inv_val)
-            /* error messages already printed. */
+        len = read (fd, buf, size);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
             return 1;
-        else
-        {
-            i = argc - optind;
-            if (i == 1)
-                opt_input = argv[optind];
-            else if (i > 1)
-            {
-                fprintf (stderr, "Specify only one input file!\n");
-                return 1;
-            }
-        }
+        buf += len;
+        size -= len;
     }
+    return 0;
+}
 
-    free_opts (&shortopts, &longopts);
+/* Reads screen file `opt_screen' into `screen_data' */
+char read_screen (void)
+{
+    struct stat st;
+    int fd;
+    char err;
 
-    /* Check values */
-    if (!opt_input)
+    fd = open (opt_screen, O_RDONLY);
+    if (fd < 0)
     {
-        fprintf (stderr, "%s %s\n", "No input file specified!", HELP_HINT);
+        fprintf (stderr, "Failed to open screen file `%s'!\n", opt_screen);
         return 1;
     }
-    if (!opt_output && !opt_auto_name)
+    err = fstat (fd, &st) || st.st_size != BINTAP_SCREEN_LEN;
+    if (err)
+        fprintf (stderr, "Screen file `%s' is not %u bytes long!\n",
+            opt_screen, BINTAP_SCREEN_LEN);
+    else if ((err = read_all (fd, screen_data, BINTAP_SCREEN_LEN)) != 0)
+        fprintf (stderr, "Failed to read screen file `%s'!\n", opt_screen);
+    close (fd);
+    return err;
+}
+
+/* Packs `screen_data' once for all jobs and sets it as the screen of `cfg' */
+char pack_screen (struct bintap_config_t *cfg)
+{
+    int status;
+
+    screen_lz = malloc (sizeof (struct lz_work_t));
+    if (!screen_lz)
     {
-        fprintf (stderr, "%s %s\n", "No output file specified!", HELP_HINT);
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+    status = bintap_pack_screen (cfg, screen_data, screen_lz);
+    if (status)
+    {
+        fprintf (stderr, "Failed to pack screen file `%s': %s!\n",
+            opt_screen, bintap_strerror (status));
+        return 1;
+    }
+    return 0;
+}
+
+/* Checks input filename `input' and gets header name `title' of its blocks
+   (`TAP_HEADER_NAME_LEN' + 1 bytes long) */
+char get_input_title (const char *input, char *title)
+{
+    char *fi_name, *fi_basename;
+
+    /* `basename()' may modify its argument */
+    fi_name = strdup (input);
+    if (!fi_name)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
         return 1;
     }
 
-    /* Check input filename `opt_input' and get `title' */
-    fi_basename = basename (opt_input);
+    fi_basename = basename (fi_name);
     if (!strcmp (fi_basename, "/")
     ||  !strcmp (fi_basename, "\\")
     ||  !strcmp (fi_basename, ".")
     ||  !strcmp (fi_basename, ".."))
     {
-        fprintf (stderr, "Invalid input file name!\n");
+        fprintf (stderr, "Invalid input file name `%s'!\n", input);
+        free (fi_name);
         return 1;
     }
     if (opt_title)
@@ -442,100 +881,2507 @@ int main (int argc, char **argv)
     else
         get_tape_header_name (title, fi_basename);
     title[TAP_HEADER_NAME_LEN] = 0;
+    free (fi_name);
+    return 0;
+}
+
+/* Maps `size' bytes of input file `fi' into memory. Inputs of `--watch' are
+   read instead: a file truncated by an assembler while it is mapped kills the
+   program by SIGBUS, while a short read just fails the conversion. */
+void *map_input (int fi, unsigned long size)
+{
+    if (opt_watch)
+        return MAP_FAILED;
+    return mmap (NULL, size, PROT_READ, MAP_PRIVATE, fi, 0);
+}
+
+/* Tokenizes BASIC text of `input' file `fi' of `size' bytes into `Program'
+   block of `tape' with header name `title' */
+char put_tokenized_file (int fi, const char *input, unsigned long size,
+    const struct bintap_config_t *cfg, char *title, TAPFILE *tape)
+{
+    unsigned int max_size = bintap_get_max_size (cfg), prog_size;
+    unsigned long line;
+    char *prog, *text = NULL;
+    void *map;
+    char err = 1;
+    int status;
 
-    /* Get output filename `fo_name' from `opt_output' or `opt_input' */
-    if (opt_output)
+    prog = malloc (max_size);
+    if (!prog)
     {
-        strncpy (fo_name, opt_output, MAX_FILENAME_LEN - 1);
-        fo_name[MAX_FILENAME_LEN - 1] = '\0';
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
     }
-    else if (opt_auto_name)
-        if (auto_output_filename (fo_name, opt_input, MAX_FILENAME_LEN - 1, DEF_FILE_EXT))
-            return 1;
 
-    fi = fopen (opt_input, "rb");
-    if (!fi)
+    map = map_input (fi, size);
+    if (map == MAP_FAILED)
+    {
+        text = malloc (size);
+        if (!text)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            goto error_exit;
+        }
+        if (read_all (fi, text, size))
+        {
+            fprintf (stderr, "Failed to read input file `%s'!\n", input);
+            goto error_exit;
+        }
+    }
+
+    status = bastok_tokenize (prog, max_size, text ? text : map, size,
+        &prog_size, &line);
+    if (status)
+        fprintf (stderr, "Failed to tokenize input file `%s' at line %lu: %s!\n",
+            input, line, bastok_strerror (status));
+    else if ((status = bintap_put_file (tape, cfg, title, prog, prog_size)) != 0)
+        fprintf (stderr, "Failed to convert input file `%s': %s!\n",
+            input, bintap_strerror (status));
+    else
+        err = 0;
+
+error_exit:
+    if (map != MAP_FAILED)
+        munmap (map, size);
+    free (text);
+    free (prog);
+    return err;
+}
+
+/* Converts `input' file into `tape'. The file is mapped into memory and passed
+   to the tape without copying, or read by `chunk' of `CHUNK_LEN' bytes when it
+   can not be mapped (see `map_input()'). The data is packed using `lz' if it
+   is not NULL. Returns sizes of input file and the tape in `in_size' and
+   `out_size'. */
+char make_tape (const char *input, const struct bintap_config_t *cfg,
+    char *chunk, struct lz_work_t *lz, TAPFILE *tape,
+    unsigned long *in_size, unsigned long *out_size)
+{
+    int fi;
+    struct stat st;
+    unsigned int fi_size, left;
+    ssize_t len;
+    void *map;
+    char title[TAP_HEADER_NAME_LEN + 1];
+    char err = 1;
+    int status;
+
+    if (get_input_title (input, title))
+        return 1;
+
+    fi = open (input, O_RDONLY);
+    if (fi < 0)
     {
-        fprintf (stderr, "Failed to open input file!\n");
+        fprintf (stderr, "Failed to open input file `%s'!\n", input);
         return 1;
     }
 
     /* Get input file size `fi_size' */
-    if (fseek (fi, 0, SEEK_END))
+    if (fstat (fi, &st))
     {
-        fprintf (stderr, "Failed to seek in input file!\n");
-        return 1;
+        fprintf (stderr, "Failed to get size of input file `%s'!\n", input);
+        goto error_exit;
     }
-    fi_size = ftell (fi);
+    fi_size = st.st_size;
     if (fi_size == 0)
     {
-        fprintf (stderr, "Input file is empty!\n");
-        return 1;
+        fprintf (stderr, "Input file `%s' is empty!\n", input);
+        goto error_exit;
     }
-    if (fi_size > MAX_DATA_LEN)
+
+    if (opt_tokenize)
     {
-        fi_size = MAX_DATA_LEN;
-        fprintf (stderr, "Warning: Input file's size exceeded %u bytes limit!\n", MAX_DATA_LEN);
+        tap_reset (tape);
+        if (put_tokenized_file (fi, input, st.st_size, cfg, title, tape))
+            goto error_exit;
+        *in_size = st.st_size;
+        *out_size = tap_get_size (tape);
+        err = 0;
+        goto error_exit;
     }
-    if (fseek (fi, 0, SEEK_SET))
+    if (st.st_size > bintap_get_max_size (cfg))
     {
-        fprintf (stderr, "Failed to seek in input file!\n");
-        return 1;
+        fi_size = bintap_get_max_size (cfg);
+        fprintf (stderr, "Warning: Input file's size exceeded %u bytes limit (`%s')!\n",
+            fi_size, input);
     }
 
-    if (opt_append)
-        fo = fopen (fo_name, "ab+");
-    else
-        fo = fopen (fo_name, "wb+");
-    if (!fo)
+    tap_reset (tape);
+
+    map = map_input (fi, fi_size);
+    if (map != MAP_FAILED)
     {
-        fprintf (stderr, "Failed to open output file!\n");
-        return 1;
+        if (lz)
+            status = bintap_put_packed_file (tape, cfg, title, map, fi_size, lz);
+        else
+            status = bintap_put_file (tape, cfg, title, map, fi_size);
+        munmap (map, fi_size);
+        goto done;
+    }
+
+    /* data split into several blocks or packed is read at once */
+    if ((cfg->chunk_size && fi_size > cfg->chunk_size) || lz)
+    {
+        map = malloc (fi_size);
+        if (!map)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            goto error_exit;
+        }
+        if (read_all (fi, map, fi_size))
+        {
+            fprintf (stderr, "Failed to read input file `%s'!\n", input);
+            free (map);
+            goto error_exit;
+        }
+        if (lz)
+            status = bintap_put_packed_file (tape, cfg, title, map, fi_size, lz);
+        else
+            status = bintap_put_file (tape, cfg, title, map, fi_size);
+        free (map);
+        goto done;
+    }
+
+    status = bintap_begin_file (tape, cfg, title, fi_size);
+
+    /* pass the data through the tape by chunks */
+    for (left = fi_size; !status && left; left -= len)
+    {
+        len = read (fi, chunk, left < CHUNK_LEN ? left : CHUNK_LEN);
+        if (len <= 0)
+        {
+            if (len < 0 && errno == EINTR)
+            {
+                len = 0;
+                continue;
+            }
+            fprintf (stderr, "Failed to read input file `%s'!\n", input);
+            goto error_exit;
+        }
+        tap_stream_data (tape, chunk, len);
+    }
+
+    if (!status)
+        status = bintap_end_file (tape);
+
+done:
+    if (status)
+    {
+        fprintf (stderr, "Failed to convert input file `%s': %s!\n",
+            input, bintap_strerror (status));
+        goto error_exit;
     }
 
-    /* start tape */
-    tap_start (&tape, buf); /* `buf' holds the whole tape file */
+    *in_size = fi_size;
+    *out_size = tap_get_size (tape);
+    err = 0;
+
+error_exit:
+    close (fi);
+    return err;
+}
+
+/* Checks that existing tape `fo' ends on a block boundary walking only length
+   fields of its blocks. With `--append-at' the tape is cut at the given block. */
+char prepare_append (int fo, const char *name)
+{
+    TAPINDEX idx;
+    unsigned long end;
+    char err = 0;
 
-    if ((!opt_program) && (opt_basic))
+    tap_index_init (&idx);
+    if (tap_index_build (&idx, fo, 0))
+    {
+        fprintf (stderr, "Failed to read output file `%s'!\n", name);
+        err = 1;
+    }
+    else if (opt_append_at != NO_BLOCK)
     {
-        if (opt_d80_syntax)
-            put_loader (&tape, "run", title);
+        if (opt_append_at > idx.count)
+        {
+            fprintf (stderr, "No block %u in `%s' (%u blocks)!\n", opt_append_at, name, idx.count);
+            err = 1;
+        }
         else
-            put_loader (&tape, title, title);
+        {
+            end = opt_append_at < idx.count ? idx.blocks[opt_append_at].offset : idx.end;
+            if (end != idx.file_size && ftruncate (fo, end))
+            {
+                fprintf (stderr, "Failed to truncate output file `%s'!\n", name);
+                err = 1;
+            }
+        }
+    }
+    else if (idx.truncated)
+    {
+        fprintf (stderr, "Output file `%s' ends inside a block after offset %lu (%u blocks)!"
+            " Use `--append-at' to replace the broken tail.\n", name, idx.end, idx.count);
+        err = 1;
+    }
+    tap_index_free (&idx);
+    return err;
+}
+
+char save_tape (int fo, const char *name, const char *data, unsigned long size)
+{
+    ssize_t len;
+
+    while (size)
+    {
+        len = write (fo, data, size);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf (stderr, "Failed to save output file `%s'!\n", name);
+            return 1;
+        }
+        data += len;
+        size -= len;
+    }
+    return 0;
+}
+
+/* Puts `.tzx' header into new output file `fo' when `.tzx' tape is made */
+char start_output (int fo, const char *name)
+{
+    char header[TZX_HEADER_LEN];
+
+    if (!opt_tzx)
+        return 0;
+    tzx_put_header (header);
+    return save_tape (fo, name, header, TZX_HEADER_LEN);
+}
+
+int open_output (const char *name)
+{
+    int fo;
+
+    /* a hard linked file (a cache entry for example) is never written through */
+    if (cache_unshare (name, opt_append))
+    {
+        fprintf (stderr, "Failed to open output file `%s'!\n", name);
+        return -1;
+    }
+    if (opt_append)
+        fo = open (name, O_RDWR | O_CREAT | O_APPEND, 0666);
+    else
+        fo = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fo < 0)
+        fprintf (stderr, "Failed to open output file `%s'!\n", name);
+    else if ((opt_append && prepare_append (fo, name))
+    ||  (!opt_append && start_output (fo, name)))
+    {
+        close (fo);
+        fo = -1;
+    }
+    return fo;
+}
+
+/* Opens a new file `tmp' (`size' bytes long buffer) in the directory of
+   output file `name' to replace it at once by `close_temp_output()' */
+int open_temp_output (const char *name, char *tmp, unsigned int size)
+{
+    int fo;
+
+    if (snprintf (tmp, size, "%s.XXXXXX", name) >= (int) size)
+    {
+        fprintf (stderr, "Output filename `%s' is too long!\n", name);
+        return -1;
+    }
+    fo = mkstemp (tmp);
+    if (fo < 0)
+        fprintf (stderr, "Failed to open output file `%s'!\n", name);
+    return fo;
+}
+
+/* Closes file `fo' opened by `open_temp_output()' as `tmp' and renames it to
+   output file `name' or removes it if `err' is set. Returns error. */
+char close_temp_output (int fo, const char *tmp, const char *name, char err)
+{
+    struct stat st;
+
+    if (err)
+    {
+        close (fo);
+        unlink (tmp);
+        return 1;
+    }
+    /* `mkstemp()' creates the file accessible by owner only */
+    if (stat (name, &st))
+        st.st_mode = 0666 & ~file_umask;
+    err = fchmod (fo, st.st_mode & 0777) != 0;
+    if (close (fo))
+        err = 1;
+    if (!err && rename (tmp, name))
+        err = 1;
+    if (err)
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        unlink (tmp);
+    }
+    return err;
+}
+
+/* Cuts off a failed tape written into output file `fo' from `pos' on */
+void drop_output (int fo, off_t pos)
+{
+    if (pos >= 0 && !ftruncate (fo, pos))
+        lseek (fo, pos, SEEK_SET);
+}
+
+/* Opens output file `name' of a batch conversion. A new tape is written into
+   a temporary file `tmp' (`size' bytes long buffer) replacing the output file
+   only when it is made, an appended one is cut back to `pos' on failure by
+   `close_batch_output()'. */
+int open_batch_output (const char *name, char *tmp, unsigned int size, off_t *pos)
+{
+    int fo;
+
+    if (opt_append)
+    {
+        fo = open_output (name);
+        if (fo >= 0)
+            *pos = lseek (fo, 0, SEEK_END);
+        return fo;
+    }
+    fo = open_temp_output (name, tmp, size);
+    if (fo >= 0 && start_output (fo, name))
+    {
+        close_temp_output (fo, tmp, name, 1);
+        fo = -1;
+    }
+    *pos = fo < 0 ? -1 : lseek (fo, 0, SEEK_CUR);
+    return fo;
+}
+
+/* Closes output file `fo' opened by `open_batch_output()' keeping the tape
+   only if `err' is not set. Returns error. */
+char close_batch_output (int fo, const char *tmp, const char *name, off_t pos, char err)
+{
+    if (!opt_append)
+        return close_temp_output (fo, tmp, name, err);
+    if (err)
+        drop_output (fo, pos);
+    if (close (fo) && !err)
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        err = 1;
+    }
+    return err;
+}
+
+/* Starts cache key `key' with version of the program and all options output
+   file depends on */
+void start_cache_key (struct cache_key_t *key)
+{
+    char buf[256];
+
+    cache_key_init (key);
+    snprintf (buf, sizeof (buf),
+        "%s-%s p%u T%u s%u l%u x%u k%u b%u d%u h%u n%u c%u e%u i%u,%u,%u z%u"
+        " f%c t%u:%u,%u,%u,%u,%u,%u,%u w%u S%u,%u,%u",
+        PROGRAM_NAME, PROGRAM_VERSION,
+        opt_program, opt_tokenize, opt_start_line, opt_load_address, opt_extra_address,
+        opt_chunk_size,
+        opt_basic, opt_d80_syntax, opt_print_headers, opt_fast_numbers,
+        opt_clear_address, opt_exec_address,
+        opt_border_color, opt_paper_color, opt_ink_color,
+        opt_compress,
+        opt_wav ? 'w' : opt_tzx ? 'z' : 't',
+        opt_turbo, opt_timing.pilot, opt_timing.sync1, opt_timing.sync2,
+        opt_timing.zero, opt_timing.one, opt_timing.pulses, opt_timing.pause,
+        opt_wav ? opt_wav_rate : 0,
+        opt_screen != NULL, opt_attrs_first, opt_pack_screen);
+    cache_key_put_string (key, buf);
+    cache_key_put (key, opt_chunk_address, opt_chunk_addresses * sizeof (opt_chunk_address[0]));
+    if (opt_screen)
+        cache_key_put (key, screen_data, BINTAP_SCREEN_LEN);
+}
+
+/* Puts header name and contents of `input' file into cache key `key'. Returns
+   size of the file in `size'. */
+char put_cache_key (struct cache_key_t *key, const char *input, unsigned long *size)
+{
+    char title[TAP_HEADER_NAME_LEN + 1];
+
+    if (get_input_title (input, title))
+        return 1;
+    cache_key_put_string (key, title);
+    return cache_key_put_file (key, input, size);
+}
+
+/* Result of conversion of one input file */
+struct convert_job_t
+{
+    char err;
+    char *data;             /* the tape to be written to a combined tape or
+                               kept for `--watch' */
+    unsigned long data_size;    /* of `data' */
+    unsigned long in_size;
+    unsigned long out_size;
+    unsigned long packed_size;  /* 0 if not packed */
+    char cached;            /* output file is taken from cache */
+    double time;
+};
+
+/* Buffers owned by one worker and reused for every file */
+struct convert_worker_t
+{
+    TAPFILE tape;
+    char *chunk;            /* a piece of input file */
+    struct lz_work_t *lz;   /* packer memory or NULL */
+    WAVFILE *wav;           /* `.wav' file renderer or NULL */
+};
+
+/* Shared state of a batch conversion */
+struct convert_batch_t
+{
+    const struct bintap_config_t *cfg;
+    unsigned int workers;
+    struct convert_worker_t *w;
+    struct convert_job_t *jobs;
+    int fo;                 /* combined tape or -1 */
+    char *fo_name;
+    WAVFILE *wav;           /* renderer of combined `.wav' file or NULL */
+};
+
+/* Renders `size' bytes of `.tzx' blocks from `data' into `wav' */
+char put_wav (WAVFILE *wav, const char *name, const char *data, unsigned long size)
+{
+    wav_put_tape (wav, data, size);
+    if (wav_get_error (wav))
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+/* Makes `.wav' file `fo' from `input' */
+char make_wav (const char *input, const struct bintap_config_t *cfg,
+    struct convert_worker_t *w, int fo, const char *fo_name,
+    unsigned long *in_size, unsigned long *out_size)
+{
+    if (make_tape (input, cfg, w->chunk, w->lz, &w->tape, in_size, out_size))
+        return 1;
+    wav_start (w->wav, fo, opt_wav_rate);
+    if (put_wav (w->wav, fo_name, w->tape.data, *out_size))
+        return 1;
+    if (wav_end (w->wav))
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", fo_name);
+        return 1;
+    }
+    *out_size = wav_get_size (w->wav);
+    return 0;
+}
+
+/* Copies tape made in `tape' into `job' */
+char keep_tape (struct convert_job_t *job, TAPFILE *tape)
+{
+    job->data_size = tap_get_size (tape);
+    job->data = malloc (job->data_size);
+    if (!job->data)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
     }
+    memcpy (job->data, tape->data, job->data_size);
+    return 0;
+}
 
-    /* new block */
-    tap_new_block (&tape);
-    tap_put_char (&tape, TAP_BLK_HEADER);
-    if (opt_program)
-        tap_put_program_header (&tape, title, fi_size, opt_start_line, fi_size);
+/* Called in a worker thread */
+void convert_proc (void *ctx, unsigned int index, unsigned int worker)
+{
+    struct convert_batch_t *batch = ctx;
+    struct convert_job_t *job = &batch->jobs[index];
+    TAPFILE *tape = &batch->w[worker].tape;
+    char *chunk = batch->w[worker].chunk;
+    struct lz_work_t *lz = batch->w[worker].lz;
+    char fo_name[MAX_FILENAME_LEN];
+    char fo_tmp[MAX_FILENAME_LEN + 8];
+    struct cache_key_t key;
+    char keyed = 0;
+    int fo;
+    off_t pos;
+    double start;
+    char err;
+
+    start = get_time ();
+    job->err = 1;
+
+    if (batch->fo >= 0)
+    {
+        if (batch->workers > 1 || batch->wav || opt_watch)
+        {
+            /* keep the tape to write it later in order of input files */
+            if (make_tape (inputs[index], batch->cfg, chunk, lz, tape, &job->in_size, &job->out_size)
+            ||  keep_tape (job, tape))
+                return;
+        }
+        else
+        {
+            /* stream directly to the combined tape, a failed tape is cut off */
+            pos = lseek (batch->fo, 0, SEEK_CUR);
+            tap_set_output (tape, batch->fo);
+            if (make_tape (inputs[index], batch->cfg, chunk, lz, tape, &job->in_size, &job->out_size))
+            {
+                drop_output (batch->fo, pos);
+                return;
+            }
+        }
+    }
     else
-        tap_put_bytes_header (&tape, title, fi_size, opt_load_address, opt_extra_address);
-    tap_end_block (&tape);
+    {
+        /* Get output filename `fo_name' from input */
+        if (auto_output_filename (fo_name, inputs[index], MAX_FILENAME_LEN - 1,
+            opt_wav ? DEF_WAV_FILE_EXT : opt_tzx ? DEF_TZX_FILE_EXT : DEF_FILE_EXT))
+            return;
+        if (opt_cache_dir)
+        {
+            start_cache_key (&key);
+            keyed = !put_cache_key (&key, inputs[index], &job->in_size);
+            if (keyed && !cache_get (opt_cache_dir, &key, fo_name, &job->out_size))
+            {
+                job->cached = 1;
+                job->time = get_time () - start;
+                job->err = 0;
+                return;
+            }
+        }
+        fo = open_batch_output (fo_name, fo_tmp, sizeof (fo_tmp), &pos);
+        if (fo < 0)
+            return;
+        if (opt_wav)
+            err = make_wav (inputs[index], batch->cfg, &batch->w[worker], fo, fo_name,
+                &job->in_size, &job->out_size);
+        else
+        {
+            /* `--watch' needs the whole tape */
+            tap_set_output (tape, opt_watch ? -1 : fo);
+            err = make_tape (inputs[index], batch->cfg, chunk, lz, tape, &job->in_size, &job->out_size);
+            tap_set_output (tape, -1);
+            if (!err && opt_watch)
+                err = save_tape (fo, fo_name, tape->data, job->out_size);
+        }
+        if (!err && opt_watch)
+            err = keep_tape (job, tape);
+        /* no partial tape is left */
+        err = close_batch_output (fo, fo_tmp, fo_name, pos, err);
+        if (err)
+            return;
+        if (keyed && cache_put (opt_cache_dir, &key, fo_name))
+            fprintf (stderr, "Warning: Failed to put `%s' into cache!\n", fo_name);
+    }
+
+    job->packed_size = lz ? lz->packed_len : 0;
+    job->time = get_time () - start;
+    job->err = 0;
+}
 
-    /* new block */
-    tap_new_block (&tape);
-    tap_put_char (&tape, TAP_BLK_DATA);
-    if (!fread (tap_get_cur_ptr (&tape), 1, fi_size, fi))
+/* Called in the main thread in order of input files */
+char convert_done (void *ctx, unsigned int index)
+{
+    struct convert_batch_t *batch = ctx;
+    struct convert_job_t *job = &batch->jobs[index];
+    unsigned long samples;
+    double start;
+    char err;
+
+    if (job->err)
+        return 1;
+
+    if (job->data && batch->fo >= 0)
+    {
+        start = get_time ();
+        if (batch->wav)
+        {
+            samples = batch->wav->samples;
+            err = put_wav (batch->wav, batch->fo_name, job->data, job->data_size);
+            job->out_size = batch->wav->samples - samples;
+        }
+        else
+            err = save_tape (batch->fo, batch->fo_name, job->data, job->data_size);
+        /* tapes are taken over by `--watch' */
+        if (!opt_watch)
+        {
+            free (job->data);
+            job->data = NULL;
+        }
+        if (err)
+            return 1;
+        job->time += get_time () - start;
+    }
+
+    if (opt_stats)
+        show_stats (inputs[index], job->in_size, job->out_size, job->packed_size,
+            job->cached, job->time);
+    return 0;
+}
+
+/* Tape of one input file kept by `--watch' */
+struct watch_input_t
+{
+    char *dir;              /* directory of input file */
+    char *name;             /* name of input file in `dir' */
+    int wd;                 /* inotify watch of `dir' */
+    char changed;
+    char *data;             /* tape made of input file */
+    unsigned long size;     /* of `data' */
+    unsigned long offset;   /* of `data' in output file */
+};
+
+/* Makes tape of `input' using buffers of worker `w' in a new buffer `data' of
+   `size' bytes */
+char make_watch_tape (const char *input, const struct bintap_config_t *cfg,
+    struct convert_worker_t *w, char **data, unsigned long *size)
+{
+    unsigned long in_size;
+
+    tap_set_output (&w->tape, -1);
+    if (make_tape (input, cfg, w->chunk, w->lz, &w->tape, &in_size, size))
+        return 1;
+    *data = malloc (*size);
+    if (!*data)
     {
-        fprintf (stderr, "Failed to read input file!\n");
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+    memcpy (*data, w->tape.data, *size);
+    return 0;
+}
+
+/* Writes tapes of `count' inputs from `in' into output file `name' (rendering
+   them into `.wav' file by `wav' if it is not NULL) and sets their offsets.
+   Returns the size of the file in `size'. */
+char write_watch_output (const char *name, struct watch_input_t *in,
+    unsigned int count, WAVFILE *wav, unsigned long *size)
+{
+    unsigned long offset = opt_tzx ? TZX_HEADER_LEN : 0;
+    unsigned int n;
+    char err = 0;
+    int fo;
+
+    fo = open_output (name);
+    if (fo < 0)
         return 1;
+    if (wav)
+        wav_start (wav, fo, opt_wav_rate);
+    for (n = 0; n < count && !err; n++)
+    {
+        in[n].offset = offset;
+        offset += in[n].size;
+        if (wav)
+            err = put_wav (wav, name, in[n].data, in[n].size);
+        else
+            err = save_tape (fo, name, in[n].data, in[n].size);
     }
-    tap_skip_data (&tape, fi_size);
-    tap_end_block (&tape);
+    if (!err && wav)
+    {
+        err = wav_end (wav);
+        if (err)
+            fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        offset = wav_get_size (wav);
+    }
+    if (close (fo) && !err)
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        err = 1;
+    }
+    *size = offset;
+    return err;
+}
+
+/* Writes `len' bytes of `data' into file `fo' at `offset' */
+char pwrite_all (int fo, const char *data, unsigned long len, unsigned long offset)
+{
+    ssize_t n;
+
+    while (len)
+    {
+        n = pwrite (fo, data, len, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Writes only runs of bytes of tape `data' differing from the old tape of `in'
+   (of the same size) into output file `name'. Runs closer than `PATCH_GAP'
+   bytes are written at once. Returns the number of bytes written in `size'. */
+char patch_watch_output (const char *name, const struct watch_input_t *in,
+    const char *data, unsigned long *size)
+{
+    unsigned long first, last, i;
+    char err = 0;
+    int fo = -1;
+
+    *size = 0;
+    for (i = 0; i < in->size && !err; i = last + 1)
+    {
+        /* find the next run */
+        for (first = i; first < in->size && in->data[first] == data[first]; first++)
+            ;
+        if (first == in->size)
+            break;
+        for (last = i = first; i < in->size && i - last <= PATCH_GAP; i++)
+            if (in->data[i] != data[i])
+                last = i;
+
+        if (fo < 0)
+        {
+            fo = cache_unshare (name, 1) ? -1 : open (name, O_WRONLY);
+            if (fo < 0)
+            {
+                fprintf (stderr, "Failed to open output file `%s'!\n", name);
+                return 1;
+            }
+        }
+        err = pwrite_all (fo, data + first, last - first + 1, in->offset + first);
+        *size += last - first + 1;
+    }
+    if (fo >= 0 && close (fo))
+        err = 1;
+    if (err)
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+    return err;
+}
+
+/* Updates output file `name' after inputs of `in' (`count' items) marked as
+   changed are converted into `data'. A tape of the same size is patched in
+   place, otherwise the whole file is written again. Frees `data'. */
+char update_watch_output (const char *name, struct watch_input_t *in,
+    unsigned int count, char **data, unsigned long *size, WAVFILE *wav,
+    double start)
+{
+    unsigned long written = 0, len;
+    char rewrite = wav != NULL, changed = 0;
+    unsigned int n;
+    char err = 0;
+
+    for (n = 0; n < count; n++)
+        if (in[n].changed)
+        {
+            changed = 1;
+            if (size[n] != in[n].size)
+                rewrite = 1;
+        }
+    if (!changed)
+        return 0;
+    for (n = 0; n < count; n++)
+        if (in[n].changed)
+        {
+            if (!rewrite && !err)
+            {
+                err = patch_watch_output (name, &in[n], data[n], &len);
+                written += len;
+            }
+            free (in[n].data);
+            in[n].data = data[n];
+            in[n].size = size[n];
+            data[n] = NULL;
+        }
+    if (rewrite)
+        err = write_watch_output (name, in, count, wav, &written);
+
+    if (!err && opt_stats)
+        fprintf (stderr, "%s: %lu bytes %s, %.3f ms\n", name, written,
+            rewrite ? "written" : "patched", (get_time () - start) * 1e3);
+    return err;
+}
+
+/* Input files watched by `--watch' */
+struct watch_t
+{
+    int fd;                 /* inotify instance */
+    struct watch_input_t *in;   /* `inputs_count' items */
+};
 
-    /* stop tape */
-    tap_end (&tape);
+/* Starts watching input files before they are converted, so a change made
+   while they are converted is not missed */
+char start_watch (struct watch_t *watch)
+{
+    struct watch_input_t *in;
+    unsigned int n;
+    char *p;
 
-    /* save */
-    fi_size = fwrite (buf, 1, tap_get_size (&tape), fo);
-    if (ferror (fo))
+    watch->in = NULL;
+    watch->fd = inotify_init1 (IN_CLOEXEC);
+    if (watch->fd < 0)
+    {
+        fprintf (stderr, "Failed to watch input files!\n");
+        return 1;
+    }
+    in = watch->in = calloc (inputs_count, sizeof (struct watch_input_t));
+    if (!in)
     {
-        fprintf (stderr, "Failed to save output file!\n");
+        fprintf (stderr, "Failed to allocate memory!\n");
         return 1;
     }
 
-    fclose (fi);
-    fclose (fo);
+    /* directories are watched as input files are often replaced */
+    for (n = 0; n < inputs_count; n++)
+    {
+        in[n].dir = strdup (inputs[n]);
+        in[n].name = strdup (inputs[n]);
+        if (!in[n].dir || !in[n].name)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            return 1;
+        }
+        /* `dirname()' and `basename()' may modify their arguments */
+        p = dirname (in[n].dir);
+        memmove (in[n].dir, p, strlen (p) + 1);
+        p = basename (in[n].name);
+        memmove (in[n].name, p, strlen (p) + 1);
+        in[n].wd = inotify_add_watch (watch->fd, in[n].dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (in[n].wd < 0)
+        {
+            fprintf (stderr, "Failed to watch input file `%s'!\n", inputs[n]);
+            return 1;
+        }
+    }
     return 0;
 }
+
+void free_watch (struct watch_t *watch)
+{
+    unsigned int n;
+
+    if (watch->in)
+        for (n = 0; n < inputs_count; n++)
+        {
+            free (watch->in[n].dir);
+            free (watch->in[n].name);
+            free (watch->in[n].data);
+        }
+    free (watch->in);
+    watch->in = NULL;
+    if (watch->fd >= 0)
+        close (watch->fd);
+    watch->fd = -1;
+}
+
+/* Converts input files again when they are written or replaced until the
+   program is stopped. Options, buffers of worker `w' and tapes of all input
+   files are kept, so only changed inputs are converted. Tapes made by the
+   batch conversion are taken from `jobs', the rest inputs are converted once
+   more. `fo_name' is combined output file or NULL. */
+char watch_inputs (struct watch_t *watch, const struct bintap_config_t *cfg,
+    struct convert_worker_t *w, struct convert_job_t *jobs, const char *fo_name)
+{
+    char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    const struct inotify_event *ev;
+    struct watch_input_t *in = watch->in;
+    char **data = NULL;
+    unsigned long *size = NULL, out_size;
+    char name[MAX_FILENAME_LEN];
+    WAVFILE *wav = NULL;
+    unsigned int n;
+    double start;
+    ssize_t len;
+    char *p, err = 1;
+    int fd = watch->fd;
+
+    data = calloc (inputs_count, sizeof (char *));
+    size = calloc (inputs_count, sizeof (unsigned long));
+    if (!data || !size || (opt_wav && !(wav = malloc (sizeof (WAVFILE)))))
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        goto error_exit;
+    }
+
+    for (n = 0; n < inputs_count; n++)
+        if (jobs[n].data)
+        {
+            in[n].data = jobs[n].data;
+            in[n].size = jobs[n].data_size;
+            jobs[n].data = NULL;
+        }
+        else if (make_watch_tape (inputs[n], cfg, w, &in[n].data, &in[n].size))
+            goto error_exit;
+    /* offsets of tapes in output files */
+    if (fo_name)
+        for (n = 0, out_size = opt_tzx ? TZX_HEADER_LEN : 0; n < inputs_count; n++)
+        {
+            in[n].offset = out_size;
+            out_size += in[n].size;
+        }
+    else
+        for (n = 0; n < inputs_count; n++)
+            in[n].offset = opt_tzx ? TZX_HEADER_LEN : 0;
+
+    fprintf (stderr, "Watching %u input files...\n", inputs_count);
+    for (;;)
+    {
+        len = read (fd, buf, sizeof (buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+        {
+            fprintf (stderr, "Failed to watch input files!\n");
+            goto error_exit;
+        }
+        /* the latency is measured from the event of closed input file */
+        start = get_time ();
+        for (p = buf; p < buf + len; p += sizeof (struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event *) p;
+            for (n = 0; n < inputs_count; n++)
+                if (ev->len && ev->wd == in[n].wd && !strcmp (ev->name, in[n].name))
+                    in[n].changed = 1;
+        }
+
+        /* a failed conversion keeps the old tape until the next change */
+        for (n = 0; n < inputs_count; n++)
+            if (in[n].changed && make_watch_tape (inputs[n], cfg, w, &data[n], &size[n]))
+            {
+                free (data[n]);
+                data[n] = NULL;
+                in[n].changed = 0;
+            }
+
+        if (fo_name)
+            update_watch_output (fo_name, in, inputs_count, data, size, wav, start);
+        else
+            for (n = 0; n < inputs_count; n++)
+                if (in[n].changed
+                &&  !auto_output_filename (name, inputs[n], MAX_FILENAME_LEN - 1,
+                        opt_wav ? DEF_WAV_FILE_EXT : opt_tzx ? DEF_TZX_FILE_EXT : DEF_FILE_EXT))
+                    update_watch_output (name, &in[n], 1, &data[n], &size[n], wav, start);
+        for (n = 0; n < inputs_count; n++)
+        {
+            free (data[n]);
+            data[n] = NULL;
+            in[n].changed = 0;
+        }
+    }
+
+error_exit:
+    if (data)
+        for (n = 0; n < inputs_count; n++)
+            free (data[n]);
+    free (data);
+    free (size);
+    free (wav);
+    return err;
+}
+
+void print_index_entry (unsigned int n, const struct tap_index_entry_t *e)
+{
+    static const char *checksum_names[] = { "-", "ok", "BAD" };
+    char name[TAP_HEADER_NAME_LEN + 1];
+
+    fprintf (stdout, "%5u %10lu %6u  %02X  ", n, e->offset, e->length, e->type);
+    if (e->is_header)
+    {
+        memcpy (name, e->header.name, TAP_HEADER_NAME_LEN);
+        name[TAP_HEADER_NAME_LEN] = '\0';
+        fprintf (stdout, "%-15s \"%s\" %5u %5u %5u",
+            tap_header_type_name (e->header.type), name,
+            e->header.length, e->header.param1, e->header.param2);
+    }
+    else
+        fprintf (stdout, "%-15s %12s %5s %5s %5s",
+            e->type == (unsigned char) TAP_BLK_DATA ? "Data" : "Other", "", "", "", "");
+    fprintf (stdout, "  %s\n", checksum_names[(int) e->checksum]);
+}
+
+/* Lists BASIC program `data' of `len' bytes (`text' is
+   `BASTOK_MAX_TEXT_LEN (TAP_MAX_BLOCK_SIZE)' bytes long) line by line */
+void list_program (const char *data, unsigned int len, char *text)
+{
+    unsigned int text_len, size;
+
+    for (; len; data += size, len -= size)
+    {
+        text_len = bastok_list_line (text, data, len, &size);
+        if (!size)
+        {
+            fprintf (stdout, "# %u bytes are not BASIC lines\n", len);
+            break;
+        }
+        fwrite (text, 1, text_len, stdout);
+    }
+}
+
+/* Lists BASIC program of block `n' of `input' tape if it is a `Program' header
+   followed by data block, or the data block itself if `any' is set. Reads the
+   data block into `buf' (`TAP_MAX_BLOCK_SIZE' bytes long). */
+char list_block (TAPINDEX *idx, unsigned int n, char any, const char *input,
+    char *buf, char *text)
+{
+    struct tap_index_entry_t *e = &idx->blocks[n];
+    char name[TAP_HEADER_NAME_LEN + 1];
+    unsigned int len;
+
+    if (e->is_header && e->header.type == TAP_HDR_PROGRAM)
+    {
+        if (n + 1 >= idx->count
+        ||  idx->blocks[n + 1].type != (unsigned char) TAP_BLK_DATA)
+            return 0;
+        memcpy (name, e->header.name, TAP_HEADER_NAME_LEN);
+        for (len = TAP_HEADER_NAME_LEN; len && name[len - 1] == ' '; len--)
+            ;
+        name[len] = '\0';
+        fprintf (stdout, "# %s: block %u \"%s\", LINE %u\n",
+            input, n, name, e->header.param1);
+        /* variables follow the program */
+        len = e->header.param2;
+        n++;
+    }
+    else if (any && e->type == (unsigned char) TAP_BLK_DATA)
+    {
+        fprintf (stdout, "# %s: block %u\n", input, n);
+        len = TAP_MAX_BLOCK_SIZE;
+    }
+    else
+        return 0;
+
+    if (tap_index_read_block (idx, n, buf))
+    {
+        fprintf (stderr, "Failed to read input file `%s'!\n", input);
+        return 1;
+    }
+    /* length field, flag and checksum are not the program */
+    if (idx->blocks[n].length < 2)
+        len = 0;
+    else if (len > idx->blocks[n].length - 2)
+        len = idx->blocks[n].length - 2;
+    list_program (buf + 3, len, text);
+    return 0;
+}
+
+/* `Bytes' block to extract */
+struct extract_entry_t
+{
+    unsigned int block;     /* of header */
+    char base[TAP_HEADER_NAME_LEN + 1];     /* file name made of header name */
+    char dup;               /* the file name was used by a previous block */
+};
+
+int compare_extract_names (const void *a, const void *b)
+{
+    const struct extract_entry_t *x = a, *y = b;
+    int c;
+
+    c = strcmp (x->base, y->base);
+    if (c)
+        return c;
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+int compare_extract_blocks (const void *a, const void *b)
+{
+    const struct extract_entry_t *x = a, *y = b;
+
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+/* Makes base of file names of header name `name' in `base'. Trailing spaces
+   are cut, characters other than letters, digits, `-', `_' and `.' (not the
+   first one) are replaced by `_'. The last `.' followed only by digits is
+   replaced too, so no base looks like a base of another block followed by its
+   number (see `get_extract_filename()'). */
+void get_extract_base (char *base, const char *name)
+{
+    unsigned int len, i;
+    char c, *dot;
+
+    for (len = TAP_HEADER_NAME_LEN; len && name[len - 1] == ' '; len--)
+        ;
+    for (i = 0; i < len; i++)
+    {
+        c = name[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+        ||  c == '-' || c == '_' || (c == '.' && i))
+            base[i] = c;
+        else
+            base[i] = '_';
+    }
+    base[len] = '\0';
+    dot = strrchr (base, '.');
+    if (dot && dot[1] && strspn (dot + 1, "0123456789") == strlen (dot + 1))
+        *dot = '_';
+}
+
+/* Makes name of file `ext' of block `n' with file name base `base' (empty if
+   none) in `dest' */
+char get_extract_filename (char *dest, unsigned int n, const char *base, char dup,
+    const char *ext)
+{
+    int r;
+
+    if (!*base)
+        r = snprintf (dest, MAX_FILENAME_LEN, "%s/block%u%s",
+            opt_output ? opt_output : ".", n, ext);
+    else if (dup)
+        r = snprintf (dest, MAX_FILENAME_LEN, "%s/%s.%u%s",
+            opt_output ? opt_output : ".", base, n, ext);
+    else
+        r = snprintf (dest, MAX_FILENAME_LEN, "%s/%s%s",
+            opt_output ? opt_output : ".", base, ext);
+    return r < 0 || r >= MAX_FILENAME_LEN;
+}
+
+/* Writes `len' bytes of data block `n' of `input' tape into a new file named
+   by `base' and the block's header `h' (or NULL) into a text file next to it */
+char extract_block (TAPINDEX *idx, unsigned int n, unsigned int len,
+    const struct tap_block_header_t *h, const char *base, char dup,
+    const char *input, char *buf)
+{
+    char name[MAX_FILENAME_LEN], info[MAX_FILENAME_LEN];
+    char title[BASTOK_MAX_STRING_LEN (TAP_HEADER_NAME_LEN)];
+    unsigned int hn = h ? n - 1 : n, i;
+    FILE *f;
+    int fo;
+    char err;
+
+    if (get_extract_filename (name, hn, base, dup, ".bin")
+    ||  get_extract_filename (info, hn, base, dup, ".txt"))
+    {
+        fprintf (stderr, "Output filename of block %u of `%s' is too long!\n", hn, input);
+        return 1;
+    }
+
+    if (cache_unshare (name, 0)
+    ||  (fo = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        fprintf (stderr, "Failed to open output file `%s'!\n", name);
+        return 1;
+    }
+    /* data follows length field and flag */
+    err = tap_index_copy_block (idx, n, 3, len, fo, buf);
+    if (err == TAP_INDEX_ERR_READ)
+        fprintf (stderr, "Failed to read input file `%s'!\n", input);
+    else if (err)
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+    if (close (fo) && !err)
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        err = 1;
+    }
+    if (err)
+        return 1;
+
+    f = fopen (info, "w");
+    if (!f)
+    {
+        fprintf (stderr, "Failed to open output file `%s'!\n", info);
+        return 1;
+    }
+    fprintf (f, "# `%s' block %u, %u bytes\n", input, hn, len);
+    fprintf (f, "bytes %s\n", strrchr (name, '/') + 1);
+    if (h)
+    {
+        for (i = TAP_HEADER_NAME_LEN; i && h->name[i - 1] == ' '; i--)
+            ;
+        /* the manifest reads escape sequences back */
+        bastok_list_string (title, h->name, i);
+        fprintf (f, "title \"%s\"\n", title);
+        fprintf (f, "load-address %u\n", h->param1);
+        fprintf (f, "extra-address %u\n", h->param2);
+    }
+    if (fclose (f))
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", info);
+        return 1;
+    }
+
+    fprintf (stdout, "%s: block %u -> %s (%u bytes", input, hn, name, len);
+    if (h)
+        fprintf (stdout, " at %u", h->param1);
+    fprintf (stdout, ")\n");
+    return 0;
+}
+
+/* Writes data of `Bytes' blocks of `input' tape with headers from `first' to
+   `last' into files named by the headers. A data block given by `--block' is
+   written without header if it has none. Only data of the blocks written is
+   read. A file name made of headers of several blocks is followed by the
+   block number except for the first one (of all blocks of the tape, so the
+   name does not depend on `--block'). */
+char extract_blocks (TAPINDEX *idx, unsigned int first, unsigned int last,
+    const char *input, char *buf)
+{
+    struct extract_entry_t *list;
+    struct tap_index_entry_t *e;
+    unsigned int count = 0, found = 0, n, len;
+    char err = 0;
+
+    /* `--block' may point to data block of a header */
+    if (last == first + 1 && first
+    &&  idx->blocks[first].type == (unsigned char) TAP_BLK_DATA
+    &&  idx->blocks[first - 1].is_header
+    &&  idx->blocks[first - 1].header.type == TAP_HDR_BYTES)
+        first--;
+
+    list = malloc (sizeof (struct extract_entry_t) * (idx->count ? idx->count : 1));
+    if (!list)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+    for (n = 0; n + 1 < idx->count; n++)
+        if (idx->blocks[n].is_header && idx->blocks[n].header.type == TAP_HDR_BYTES
+        &&  idx->blocks[n + 1].type == (unsigned char) TAP_BLK_DATA)
+        {
+            list[count].block = n;
+            get_extract_base (list[count].base, idx->blocks[n].header.name);
+            list[count].dup = 0;
+            count++;
+        }
+    /* different titles may make the same file name */
+    qsort (list, count, sizeof (struct extract_entry_t), compare_extract_names);
+    for (n = 1; n < count; n++)
+        list[n].dup = !strcmp (list[n].base, list[n - 1].base);
+    qsort (list, count, sizeof (struct extract_entry_t), compare_extract_blocks);
+
+    for (n = 0; n < count && !err; n++)
+    {
+        if (list[n].block < first || list[n].block >= last)
+            continue;
+        e = &idx->blocks[list[n].block];
+        len = e[1].length < 2 ? 0 : e[1].length - 2;
+        if (len != e->header.length)
+            fprintf (stderr, "Data of block %u of `%s' is %u bytes long instead of %u!\n",
+                list[n].block, input, len, e->header.length);
+        /* ROM does not load more than the header says */
+        if (len > e->header.length)
+            len = e->header.length;
+        err = extract_block (idx, list[n].block + 1, len, &e->header, list[n].base,
+            list[n].dup, input, buf);
+        found++;
+    }
+
+    /* a data block without `Bytes' header is written as is */
+    if (!err && !found && opt_block != NO_BLOCK)
+    {
+        e = &idx->blocks[opt_block];
+        if (e->type != (unsigned char) TAP_BLK_DATA || e->length < 2)
+        {
+            fprintf (stderr, "Block %u of `%s' is neither `Bytes' nor data block!\n",
+                opt_block, input);
+            err = 1;
+        }
+        else
+            err = extract_block (idx, opt_block, e->length - 2, NULL, "", 0, input, buf);
+    }
+
+    free (list);
+    return err;
+}
+
+/* Lists blocks of tape file `input' or shows its summary */
+char inspect_tape (const char *input)
+{
+    TAPINDEX idx;
+    char *buf = NULL, *text = NULL;
+    unsigned int n, first, last, headers = 0, bad = 0;
+    int fd;
+    char err = 0;
+
+    fd = open (input, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf (stderr, "Failed to open input file `%s'!\n", input);
+        return 1;
+    }
+
+    /* check all blocks during one pass or only the requested one */
+    tap_index_init (&idx);
+    if (tap_index_build (&idx, fd, (opt_list || opt_info) && opt_block == NO_BLOCK))
+    {
+        fprintf (stderr, "Failed to read input file `%s'!\n", input);
+        err = 1;
+        goto error_exit;
+    }
+    first = 0;
+    last = idx.count;
+    if (opt_block != NO_BLOCK)
+    {
+        if (opt_block >= idx.count)
+        {
+            fprintf (stderr, "No block %u in `%s' (%u blocks)!\n", opt_block, input, idx.count);
+            err = 1;
+            goto error_exit;
+        }
+        buf = malloc (TAP_MAX_BLOCK_SIZE);
+        if (!buf)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            err = 1;
+            goto error_exit;
+        }
+        if ((opt_list || opt_info)
+        &&  tap_index_check_block (&idx, opt_block, buf))
+        {
+            fprintf (stderr, "Failed to read input file `%s'!\n", input);
+            err = 1;
+            goto error_exit;
+        }
+        first = opt_block;
+        last = opt_block + 1;
+    }
+
+    if (opt_list)
+    {
+        fprintf (stdout, "%s:\n", input);
+        fprintf (stdout, "%5s %10s %6s  %s  %-15s %-12s %5s %5s %5s  %s\n",
+            "Block", "Offset", "Length", "Flag", "Type", "Name", "Size", "Par1", "Par2", "Checksum");
+        for (n = first; n < last; n++)
+            print_index_entry (n, &idx.blocks[n]);
+        /* a tape cut short or a file which is not a tape (`.tzx' for example) */
+        if (idx.truncated)
+        {
+            fprintf (stdout, "%s: truncated after offset %lu\n", input, idx.end);
+            err = 1;
+        }
+    }
+
+    if (opt_info)
+    {
+        for (n = first; n < last; n++)
+        {
+            if (idx.blocks[n].is_header)
+                headers++;
+            if (idx.blocks[n].checksum == TAP_CHECKSUM_BAD)
+                bad++;
+        }
+        fprintf (stdout, "%s: %u blocks (%u headers), %lu bytes, %u bad checksums",
+            input, last - first, headers, idx.file_size, bad);
+        if (idx.truncated)
+            fprintf (stdout, ", truncated after offset %lu", idx.end);
+        fprintf (stdout, "\n");
+    }
+
+    if (opt_detokenize)
+    {
+        /* only one block is read at a time */
+        if (!buf)
+            buf = malloc (TAP_MAX_BLOCK_SIZE);
+        text = malloc (BASTOK_MAX_TEXT_LEN (TAP_MAX_BLOCK_SIZE));
+        if (!buf || !text)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            err = 1;
+            goto error_exit;
+        }
+        for (n = first; n < last && !err; n++)
+            err = list_block (&idx, n, opt_block != NO_BLOCK, input, buf, text);
+    }
+
+    if (opt_extract && !err)
+    {
+        if (!buf)
+            buf = malloc (TAP_MAX_BLOCK_SIZE);
+        if (!buf)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            err = 1;
+            goto error_exit;
+        }
+        err = extract_blocks (&idx, first, last, input, buf);
+    }
+
+error_exit:
+    free (text);
+    free (buf);
+    tap_index_free (&idx);
+    close (fd);
+    return err;
+}
+
+struct verify_job_t
+{
+    char err;               /* failed to read or repair the tape */
+    char *report;           /* lines of found problems */
+    size_t report_len;
+    unsigned long size;
+    unsigned int blocks;
+    unsigned int problems;
+    unsigned int repaired;
+    double time;
+};
+
+struct verify_batch_t
+{
+    struct verify_job_t *jobs;
+    char **buf;             /* a block for each worker */
+};
+
+/* Checks every block of tape file `input' (and repairs it with `--repair').
+   Found problems are written by lines into `report' of `job'. */
+char verify_tape (const char *input, char *buf, struct verify_job_t *job)
+{
+    TAPINDEX idx;
+    FILE *f;
+    unsigned int n, problems, p;
+    char err = 1;
+    int fd;
+
+    f = open_memstream (&job->report, &job->report_len);
+    if (!f)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+
+    /* a tape hard linked to cache entry is repaired alone */
+    if (opt_repair && cache_unshare (input, 1))
+    {
+        fprintf (stderr, "Failed to copy input file `%s'!\n", input);
+        fclose (f);
+        return 1;
+    }
+    fd = open (input, opt_repair ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf (stderr, "Failed to open input file `%s'!\n", input);
+        fclose (f);
+        return 1;
+    }
+
+    tap_index_init (&idx);
+    if (tap_index_build (&idx, fd, 1))
+    {
+        fprintf (stderr, "Failed to read input file `%s'!\n", input);
+        goto error_exit;
+    }
+    job->size = idx.file_size;
+    job->blocks = idx.count;
+
+    for (n = 0; n < idx.count; n++)
+    {
+        problems = tap_index_get_problems (&idx, n);
+        for (p = 1; problems; p <<= 1)
+        {
+            if (!(problems & p))
+                continue;
+            problems &= ~p;
+            job->problems++;
+            fprintf (f, "%s: block %u at offset %lu: %s", input, n,
+                idx.blocks[n].offset, tap_problem_name (p));
+            if (opt_repair && p == TAP_PROBLEM_CHECKSUM)
+            {
+                if (tap_index_fix_checksum (&idx, n, buf))
+                {
+                    fprintf (stderr, "Failed to repair input file `%s'!\n", input);
+                    goto error_exit;
+                }
+                fprintf (f, " (repaired)");
+                job->repaired++;
+            }
+            fprintf (f, "\n");
+        }
+    }
+
+    if (idx.truncated)
+    {
+        job->problems++;
+        fprintf (f, "%s: block %u at offset %lu: truncated (%lu bytes)", input,
+            idx.count, idx.end, idx.file_size - idx.end);
+        if (opt_repair)
+        {
+            /* the incomplete block is cut off */
+            if (ftruncate (fd, idx.end))
+            {
+                fprintf (stderr, "Failed to repair input file `%s'!\n", input);
+                goto error_exit;
+            }
+            fprintf (f, " (repaired)");
+            job->repaired++;
+        }
+        fprintf (f, "\n");
+    }
+    err = 0;
+
+error_exit:
+    tap_index_free (&idx);
+    close (fd);
+    if (fclose (f))
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        err = 1;
+    }
+    return err;
+}
+
+void verify_proc (void *ctx, unsigned int index, unsigned int worker)
+{
+    struct verify_batch_t *batch = ctx;
+    struct verify_job_t *job = &batch->jobs[index];
+    double start;
+
+    start = get_time ();
+    job->err = verify_tape (inputs[index], batch->buf[worker], job);
+    job->time = get_time () - start;
+}
+
+char verify_done (void *ctx, unsigned int index)
+{
+    struct verify_batch_t *batch = ctx;
+    struct verify_job_t *job = &batch->jobs[index];
+
+    if (job->report)
+        fwrite (job->report, 1, job->report_len, stdout);
+    if (opt_stats)
+        fprintf (stderr, "%s: %lu bytes, %u blocks, %u problems, %.3f ms, %.2f MB/s\n",
+            inputs[index], job->size, job->blocks, job->problems, job->time * 1e3,
+            job->time > 0 ? job->size / job->time / 1e6 : 0.0);
+    return 0;
+}
+
+/* Checks all input tapes using `--jobs' threads and shows a summary. Returns 0
+   if all of them are good (or repaired). */
+char verify_tapes (void)
+{
+    struct verify_batch_t batch;
+    unsigned int workers, n, problems = 0, repaired = 0, failed = 0;
+    unsigned long size = 0;
+    double start;
+    char err = 1;
+
+    workers = opt_jobs < inputs_count ? opt_jobs : inputs_count;
+    batch.jobs = calloc (inputs_count, sizeof (struct verify_job_t));
+    batch.buf = calloc (workers, sizeof (char *));
+    if (!batch.jobs || !batch.buf)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        goto error_exit;
+    }
+    for (n = 0; n < workers; n++)
+    {
+        batch.buf[n] = malloc (TAP_MAX_BLOCK_SIZE);
+        if (!batch.buf[n])
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            goto error_exit;
+        }
+    }
+
+    start = get_time ();
+    if (run_jobs (inputs_count, workers, verify_proc, verify_done, &batch))
+        goto error_exit;
+    start = get_time () - start;
+
+    for (n = 0; n < inputs_count; n++)
+    {
+        size += batch.jobs[n].size;
+        problems += batch.jobs[n].problems;
+        repaired += batch.jobs[n].repaired;
+        failed += batch.jobs[n].err;
+    }
+    fprintf (stdout, "Total: %u files, %lu bytes, %u problems", inputs_count, size, problems);
+    if (opt_repair)
+        fprintf (stdout, " (%u repaired)", repaired);
+    if (failed)
+        fprintf (stdout, ", %u files failed", failed);
+    fprintf (stdout, ", %.3f ms, %.2f MB/s\n", start * 1e3,
+        start > 0 ? size / start / 1e6 : 0.0);
+    err = failed || problems > repaired;
+
+error_exit:
+    if (batch.jobs)
+        for (n = 0; n < inputs_count; n++)
+            free (batch.jobs[n].report);
+    if (batch.buf)
+        for (n = 0; n < workers; n++)
+            free (batch.buf[n]);
+    free (batch.buf);
+    free (batch.jobs);
+    return err;
+}
+
+/* Block `block' of input tape `tape' */
+struct edit_block_t
+{
+    unsigned int tape;
+    unsigned int block;
+    char edited;            /* header is changed by `--set-header' */
+    char deleted;           /* block is removed by `--delete' */
+};
+
+/* Puts blocks `first' to `last' (not included) of input tape `n' at `b' */
+struct edit_block_t *put_edit_blocks (struct edit_block_t *b, unsigned int n,
+    unsigned int first, unsigned int last)
+{
+    for (; first < last; first++, b++)
+    {
+        b->tape = n;
+        b->block = first;
+        b->edited = 0;
+        b->deleted = 0;
+    }
+    return b;
+}
+
+/* Writes header block `b' changed by `--set-header' into `fo' */
+char put_edited_header (int fo, const char *name, TAPINDEX *tapes,
+    const struct edit_block_t *b, char *buf)
+{
+    struct tap_index_entry_t *e = &tapes[b->tape].blocks[b->block];
+    struct tap_block_header_t h;
+
+    if (tap_index_read_block (&tapes[b->tape], b->block, buf))
+    {
+        fprintf (stderr, "Failed to read input file `%s'!\n", inputs[b->tape]);
+        return 1;
+    }
+    memcpy (&h, buf + 3, sizeof (h));
+    if (opt_set_header.title)
+        fill_tape_header_name (h.name, opt_set_header.title);
+    if (opt_set_header.param1 != NO_VALUE)
+        h.param1 = opt_set_header.param1;
+    if (opt_set_header.param2 != NO_VALUE)
+        h.param2 = opt_set_header.param2;
+    memcpy (buf + 3, &h, sizeof (h));
+    buf[2 + e->length - 1] = xor_checksum (0, buf + 2, e->length - 1);
+    return save_tape (fo, name, buf, e->length + 2);
+}
+
+/* Writes blocks `list' (`count' items) into new tape `fo'. Runs of blocks
+   following each other in the same input tape are copied at once. */
+char put_edited_tape (int fo, const char *name, TAPINDEX *tapes,
+    const struct edit_block_t *list, unsigned int count, char *buf)
+{
+    const struct edit_block_t *b = list, *end = list + count;
+    TAPINDEX *t;
+    unsigned long first, last;
+    char err = 0;
+
+    while (b < end && !err)
+    {
+        if (b->edited)
+        {
+            err = put_edited_header (fo, name, tapes, b++, buf);
+            continue;
+        }
+        t = &tapes[b->tape];
+        first = t->blocks[b->block].offset;
+        last = first;
+        do
+        {
+            last += t->blocks[b->block].length + 2;
+            b++;
+        }
+        while (b < end && !b->edited && b->tape == b[-1].tape && b->block == b[-1].block + 1);
+        err = tap_index_copy_range (t, first, last - first, fo, buf);
+        if (err == TAP_INDEX_ERR_WRITE)
+            fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        else if (err)
+            fprintf (stderr, "Failed to read input file `%s'!\n", inputs[b[-1].tape]);
+    }
+    return err;
+}
+
+/* Returns 1 if `list' has block `n' */
+char block_list_has (const struct block_list_t *list, unsigned int n)
+{
+    const struct block_range_t *r;
+
+    for (r = list->ranges; r < list->ranges + list->count; r++)
+        if (r->first <= r->last ? n >= r->first && n <= r->last : n >= r->last && n <= r->first)
+            return 1;
+    return 0;
+}
+
+/* Checks that blocks of `list' are in joined tape of `count' blocks */
+char check_block_list (const struct block_list_t *list, unsigned int count)
+{
+    const struct block_range_t *r;
+
+    for (r = list->ranges; r < list->ranges + list->count; r++)
+        if (r->first >= count || r->last >= count)
+        {
+            fprintf (stderr, "No block %u in joined tape (%u blocks)!\n",
+                r->first >= count ? r->first : r->last, count);
+            return 1;
+        }
+    return 0;
+}
+
+/* Joins blocks of input tapes (other tapes inserted into the first one with
+   `--insert-at'), picks them by `--blocks' and `--delete', changes a header
+   by `--set-header' and writes the result into a new file renamed to the
+   output file, so an input may be the output too. Only length fields and
+   headers are read, data of blocks is copied between files by the kernel. */
+char edit_tapes (void)
+{
+    TAPINDEX *tapes;
+    struct edit_block_t *joined = NULL, *list = NULL, *b;
+    const struct block_range_t *r;
+    unsigned int joined_count = 0, count = 0, n, step;
+    unsigned long in_size = 0;
+    char tmp[MAX_FILENAME_LEN + 8];
+    char *buf = NULL;
+    off_t size;
+    int fd, fo = -1;
+    double start;
+    char err = 0;
+
+    if (!opt_output)
+    {
+        fprintf (stderr, "%s %s\n", "No output file specified!", HELP_HINT);
+        return 1;
+    }
+    start = get_time ();
+
+    tapes = malloc (sizeof (TAPINDEX) * inputs_count);
+    if (!tapes)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+    for (n = 0; n < inputs_count; n++)
+        tap_index_init (&tapes[n]);
+    for (n = 0; n < inputs_count && !err; n++)
+    {
+        fd = open (inputs[n], O_RDONLY);
+        if (fd < 0)
+        {
+            fprintf (stderr, "Failed to open input file `%s'!\n", inputs[n]);
+            err = 1;
+        }
+        else if (tap_index_build (&tapes[n], fd, 0))
+        {
+            fprintf (stderr, "Failed to read input file `%s'!\n", inputs[n]);
+            err = 1;
+        }
+        else if (tapes[n].truncated)
+        {
+            fprintf (stderr, "Input file `%s' ends inside a block after offset %lu!"
+                " Use `--repair' to cut the broken tail.\n", inputs[n], tapes[n].end);
+            err = 1;
+        }
+        else
+        {
+            joined_count += tapes[n].count;
+            in_size += tapes[n].file_size;
+        }
+    }
+    if (err)
+        goto error_exit;
+    if (opt_insert_at != NO_BLOCK && opt_insert_at > tapes[0].count)
+    {
+        fprintf (stderr, "No block %u in `%s' (%u blocks)!\n",
+            opt_insert_at, inputs[0], tapes[0].count);
+        err = 1;
+        goto error_exit;
+    }
+
+    /* blocks of the joined tape */
+    joined = malloc (sizeof (struct edit_block_t) * (joined_count ? joined_count : 1));
+    buf = malloc (TAP_MAX_BLOCK_SIZE);
+    if (!joined || !buf)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        err = 1;
+        goto error_exit;
+    }
+    if (opt_insert_at != NO_BLOCK)
+    {
+        b = put_edit_blocks (joined, 0, 0, opt_insert_at);
+        for (n = 1; n < inputs_count; n++)
+            b = put_edit_blocks (b, n, 0, tapes[n].count);
+        put_edit_blocks (b, 0, opt_insert_at, tapes[0].count);
+    }
+    else
+        for (b = joined, n = 0; n < inputs_count; n++)
+            b = put_edit_blocks (b, n, 0, tapes[n].count);
+
+    if (check_block_list (&opt_blocks, joined_count)
+    ||  check_block_list (&opt_delete, joined_count))
+    {
+        err = 1;
+        goto error_exit;
+    }
+    if (opt_set_header.block != NO_BLOCK)
+    {
+        b = opt_set_header.block < joined_count ? &joined[opt_set_header.block] : NULL;
+        if (!b || !tapes[b->tape].blocks[b->block].is_header)
+        {
+            fprintf (stderr, "Block %u of joined tape is not a header!\n", opt_set_header.block);
+            err = 1;
+            goto error_exit;
+        }
+        b->edited = 1;
+    }
+    for (n = 0; n < joined_count; n++)
+        joined[n].deleted = block_list_has (&opt_delete, n);
+
+    /* blocks in order of `--blocks' (repeated ones too) */
+    if (opt_blocks.count)
+    {
+        for (r = opt_blocks.ranges; r < opt_blocks.ranges + opt_blocks.count; r++)
+            count += (r->first <= r->last ? r->last - r->first : r->first - r->last) + 1;
+        list = malloc (sizeof (struct edit_block_t) * count);
+        if (!list)
+        {
+            fprintf (stderr, "Failed to allocate memory!\n");
+            err = 1;
+            goto error_exit;
+        }
+        b = list;
+        for (r = opt_blocks.ranges; r < opt_blocks.ranges + opt_blocks.count; r++)
+        {
+            step = r->first <= r->last ? 1 : -1;
+            for (n = r->first; ; n += step)
+            {
+                *(b++) = joined[n];
+                if (n == r->last)
+                    break;
+            }
+        }
+    }
+    else
+    {
+        list = joined;
+        count = joined_count;
+        joined = NULL;
+    }
+    for (b = list, n = 0; n < count; n++)
+        if (!list[n].deleted)
+            *(b++) = list[n];
+    count = b - list;
+
+    /* the output file is replaced at once */
+    fo = open_temp_output (opt_output, tmp, sizeof (tmp));
+    if (fo < 0)
+    {
+        err = 1;
+        goto error_exit;
+    }
+    err = put_edited_tape (fo, opt_output, tapes, list, count, buf);
+    size = lseek (fo, 0, SEEK_END);
+    err = close_temp_output (fo, tmp, opt_output, err);
+    if (!err && opt_stats)
+        fprintf (stderr, "%s: %u blocks of %u files, %lu -> %lu bytes, %.3f ms\n",
+            opt_output, count, inputs_count, in_size, (unsigned long) size,
+            (get_time () - start) * 1e3);
+
+error_exit:
+    for (n = 0; n < inputs_count; n++)
+    {
+        if (tapes[n].fd >= 0)
+            close (tapes[n].fd);
+        tap_index_free (&tapes[n]);
+    }
+    free (tapes);
+    free (joined);
+    free (list);
+    free (buf);
+    return err;
+}
+
+/* Puts block `item' of manifest into `tape'. Its file `path' is read into
+   `data' (`BINTAP_MAX_DATA_LEN' bytes long). */
+char put_manifest_item (TAPFILE *tape, const struct manifest_item_t *item,
+    const char *path, char *data, unsigned long *in_size)
+{
+    struct bintap_config_t cfg;
+    struct stat st;
+    int fi, status;
+    char err = 1;
+
+    fi = open (path, O_RDONLY);
+    if (fi < 0)
+    {
+        fprintf (stderr, "Failed to open input file `%s'!\n", path);
+        return 1;
+    }
+    if (fstat (fi, &st))
+    {
+        fprintf (stderr, "Failed to get size of input file `%s'!\n", path);
+        goto error_exit;
+    }
+    if (!st.st_size)
+    {
+        fprintf (stderr, "Input file `%s' is empty!\n", path);
+        goto error_exit;
+    }
+    *in_size += st.st_size;
+
+    bintap_init_config (&cfg);
+    if (item->type == MANIFEST_PROGRAM)
+    {
+        cfg.program = 1;
+        cfg.start_line = item->start_line;
+        err = put_tokenized_file (fi, path, st.st_size, &cfg, (char *) item->title, tape);
+        goto error_exit;
+    }
+
+    if (st.st_size > BINTAP_MAX_DATA_LEN)
+    {
+        fprintf (stderr, "Input file `%s' is longer than %u bytes!\n", path, BINTAP_MAX_DATA_LEN);
+        goto error_exit;
+    }
+    if (item->type == MANIFEST_SCREEN && st.st_size != BINTAP_SCREEN_LEN)
+    {
+        fprintf (stderr, "Screen file `%s' is not %u bytes long!\n", path, BINTAP_SCREEN_LEN);
+        goto error_exit;
+    }
+    if (read_all (fi, data, st.st_size))
+    {
+        fprintf (stderr, "Failed to read input file `%s'!\n", path);
+        goto error_exit;
+    }
+    cfg.load_address = item->load_address;
+    cfg.extra_address = item->extra_address;
+    if (item->load_address + st.st_size > BINTAP_MAX_ADDR + 1)
+        status = BINTAP_ERR_ADDRESS;
+    else
+        status = bintap_put_file (tape, &cfg, (char *) item->title, data, st.st_size);
+    if (status)
+        fprintf (stderr, "Failed to convert input file `%s': %s!\n",
+            path, bintap_strerror (status));
+    else
+        err = 0;
+
+error_exit:
+    close (fi);
+    return err;
+}
+
+/* Puts BASIC loader of manifest `m' (at `n' item) loading and calling the
+   blocks following it */
+char put_manifest_loader (TAPFILE *tape, const MANIFEST *m, unsigned int n)
+{
+    struct bintap_step_t steps[BINTAP_MAX_STEPS];
+    const struct manifest_item_t *item;
+    char title[TAP_HEADER_NAME_LEN + 1];
+    unsigned int count = 0;
+    int status;
+
+    strcpy (title, m->items[n].title);
+    for (item = &m->items[n + 1]; item < m->items + m->count; item++)
+    {
+        if (item->load)
+        {
+            /* the loader is named after the first block as usual */
+            if (!*title)
+                strcpy (title, item->title);
+            steps[count].type = item->type == MANIFEST_SCREEN
+                ? BINTAP_STEP_SCREEN : BINTAP_STEP_LOAD;
+            steps[count++].name = (char *) item->title;
+        }
+        if (item->call != MANIFEST_NO_CALL)
+        {
+            steps[count].type = BINTAP_STEP_CALL;
+            steps[count++].address = item->call;
+        }
+    }
+    if (m->loader.d80_syntax && !*m->items[n].title)
+        strcpy (title, "run");
+    else if (!*title)
+        strcpy (title, "loader");
+    status = bintap_put_steps_loader (tape, &m->loader, title, steps, count);
+    if (status)
+    {
+        fprintf (stderr, "Failed to make loader of manifest `%s': %s!\n",
+            opt_manifest, bintap_strerror (status));
+        return 1;
+    }
+    return 0;
+}
+
+/* Makes tape described by manifest `opt_manifest' in memory and writes it
+   into output file `name' at once */
+char make_manifest_tape (const char *name)
+{
+    MANIFEST m;
+    TAPFILE tape;
+    struct manifest_item_t *item;
+    char path[MAX_FILENAME_LEN];
+    char *text = NULL, *data = NULL, *dir, *copy;
+    unsigned long in_size = 0, line;
+    struct stat st;
+    double start;
+    int fd, status, len;
+    unsigned int n;
+    char err = 1;
+
+    start = get_time ();
+    manifest_init (&m);
+    if (tap_start_dynamic (&tape, TAP_FLUSH_SIZE * 2))
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+    copy = NULL;
+
+    fd = open (opt_manifest, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf (stderr, "Failed to open manifest `%s'!\n", opt_manifest);
+        goto error_exit;
+    }
+    /* the text is cut into values by the parser */
+    text = fstat (fd, &st) ? NULL : malloc (st.st_size + 1);
+    copy = strdup (opt_manifest);
+    data = malloc (BINTAP_MAX_DATA_LEN);
+    if (!text || !copy || !data || read_all (fd, text, st.st_size))
+    {
+        fprintf (stderr, "Failed to read manifest `%s'!\n", opt_manifest);
+        close (fd);
+        goto error_exit;
+    }
+    close (fd);
+    status = manifest_parse (&m, text, st.st_size, &line);
+    if (status)
+    {
+        fprintf (stderr, "Manifest `%s', line %lu: %s!\n",
+            opt_manifest, line, manifest_strerror (status));
+        goto error_exit;
+    }
+
+    /* files are relative to the manifest; titles are needed by the loader */
+    dir = dirname (copy);
+    for (item = m.items; item < m.items + m.count; item++)
+        if (item->file && !*item->title && get_input_title (item->file, item->title))
+            goto error_exit;
+
+    for (n = 0; n < m.count; n++)
+    {
+        item = &m.items[n];
+        if (item->type == MANIFEST_LOADER)
+        {
+            if (put_manifest_loader (&tape, &m, n))
+                goto error_exit;
+            continue;
+        }
+        if (item->file[0] == '/')
+            len = snprintf (path, MAX_FILENAME_LEN, "%s", item->file);
+        else
+            len = snprintf (path, MAX_FILENAME_LEN, "%s/%s", dir, item->file);
+        if (len >= MAX_FILENAME_LEN)
+        {
+            fprintf (stderr, "Input filename `%s' is too long!\n", item->file);
+            goto error_exit;
+        }
+        if (put_manifest_item (&tape, item, path, data, &in_size))
+            goto error_exit;
+    }
+    if (tap_get_error (&tape))
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        goto error_exit;
+    }
+
+    /* one write of the whole tape */
+    fd = open_output (name);
+    if (fd < 0)
+        goto error_exit;
+    err = save_tape (fd, name, tape.data, tap_get_size (&tape));
+    if (close (fd) && !err)
+    {
+        fprintf (stderr, "Failed to save output file `%s'!\n", name);
+        err = 1;
+    }
+    if (!err && opt_stats)
+        show_stats (opt_manifest, in_size, tap_get_size (&tape), 0, 0, get_time () - start);
+
+error_exit:
+    manifest_free (&m);
+    tap_free (&tape);
+    free (text);
+    free (data);
+    free (copy);
+    return err;
+}
+
+void shutdown (void)
+{
+    free_opts (&shortopts, &longopts);
+    free (opt_blocks.ranges);
+    free (opt_delete.ranges);
+    free (screen_lz);
+    free_inputs ();
+}
+
+int main (int argc, char **argv)
+{
+    char inv_opt = 0, inv_val = 0;
+    int c, i;
+    char short_name[2];
+    const char *opt_name;
+    char *name;
+    unsigned int n;
+    unsigned long total_in = 0, total_out = 0, size;
+    double time, total_start;
+    char fo_name[MAX_FILENAME_LEN];
+    char fo_tmp[MAX_FILENAME_LEN + 8];
+    off_t fo_pos;
+    struct bintap_config_t cfg;
+    struct convert_batch_t batch;
+    struct cache_key_t key;
+    struct watch_t watch = { -1, NULL };
+    char keyed = 0, cached = 0;
+    char err;
+
+    atexit (shutdown);
+
+    file_umask = umask (0);
+    umask (file_umask);
+
+    if (init_opts (ext_options, &shortopts, &longopts))
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        return 1;
+    }
+
+    if (argc > 1)
+    {
+        optind = 0; /* reset option index */
+        while (!inv_opt && !inv_val)
+        {
+            /* `shortopts' must be a valid ASCIZ string, not NULL */
+            c = getopt_long (argc, argv, shortopts, longopts, &i);
+            if (c == -1)    /* end of the options */
+                break;
+            switch (c)
+            {
+            case 0:
+                /* long option */
+                opt_name = longopts[i].name;
+                i = find_long_opt (ext_options, opt_name);
+                if (i == -1)
+                    fprintf (stderr, "getopt_long() returned unknown option `%s'!\n", opt_name);
+                else
+                    inv_val = set_opt (ext_options, 1, opt_name, i);
+                break;
+            case '?':
+                /* getopt_long() already printed an error message. */
+                short_name[0] = optopt;
+                short_name[1] = '\0';
+                opt_name = short_name;
+                inv_opt = 1;
+                break;
+            default:
+                /* short option */
+                short_name[0] = c;
+                short_name[1] = '\0';
+                opt_name = short_name;
+                i = find_short_opt (ext_options, c);
+                if (i == -1)
+                    fprintf (stderr, "getopt_long() returned unknown character `\\x%02hhX'!\n", c);
+                else
+                    inv_val = set_opt (ext_options, 0, opt_name, i);
+            }
+        }
+        if (inv_opt || inv_val)
+            /* error messages already printed. */
+            return 1;
+        else
+        {
+            if (opt_input_list)
+            {
+                inputs_owned = 1;
+                if (read_input_list (opt_input_list))
+                    return 1;
+            }
+            for (i = optind; i < argc; i++)
+            {
+                name = inputs_owned ? strdup (argv[i]) : argv[i];
+                if (!name)
+                {
+                    fprintf (stderr, "Failed to allocate memory!\n");
+                    return 1;
+                }
+                if (add_input (name))
+                {
+                    if (inputs_owned)
+                        free (name);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    free_opts (&shortopts, &longopts);
+
+    if (opt_append_at != NO_BLOCK)
+        opt_append = 1;
+
+    /* BASIC text is made into `Program' */
+    if (opt_tokenize)
+        opt_program = 1;
+
+    if (opt_program && (opt_chunk_size || opt_chunk_addresses))
+    {
+        fprintf (stderr, "Program can not be split into blocks!\n");
+        return 1;
+    }
+
+    if (opt_tzx && opt_wav)
+    {
+        fprintf (stderr, "Only one of `.tzx' tape and `.wav' file can be made!\n");
+        return 1;
+    }
+
+    if (opt_turbo && !opt_wav)
+        opt_tzx = 1;
+
+    if ((opt_tzx || opt_wav) && opt_append)
+    {
+        fprintf (stderr, "Only `.tap' tape can be appended!\n");
+        return 1;
+    }
+
+    if (opt_turbo && opt_basic && opt_d80_syntax)
+    {
+        fprintf (stderr, "Turbo loader can not be made with D80 syntax!\n");
+        return 1;
+    }
+
+    if (opt_turbo && opt_basic && turbo_check_timing (&opt_timing))
+    {
+        fprintf (stderr, "Turbo loader needs ROM pilot and sync timings (%u,%u,%u),"
+            " at least %u pilot pulses and distinct ZERO and ONE!\n",
+            TZX_ROM_PILOT, TZX_ROM_SYNC1, TZX_ROM_SYNC2, TURBO_MIN_PULSES);
+        return 1;
+    }
+
+    if (opt_compress && (opt_program || opt_chunk_size || opt_chunk_addresses))
+    {
+        fprintf (stderr, "Only a single `Bytes' block can be packed!\n");
+        return 1;
+    }
+
+    if (opt_screen && opt_program)
+    {
+        fprintf (stderr, "Screen can not be put in front of `Program'!\n");
+        return 1;
+    }
+
+    if ((opt_attrs_first || opt_pack_screen) && !opt_screen)
+    {
+        fprintf (stderr, "No screen file specified by `--screen'!\n");
+        return 1;
+    }
+
+    if (opt_attrs_first && opt_pack_screen)
+    {
+        fprintf (stderr, "Only one of `--attrs-first' and `--pack-screen' can be used!\n");
+        return 1;
+    }
+
+    if (opt_pack_screen && !opt_basic)
+    {
+        fprintf (stderr, "Packed screen is unpacked only by BASIC loader!\n");
+        return 1;
+    }
+
+    if (opt_cache_dir && opt_append)
+    {
+        fprintf (stderr, "Appended tape can not be cached!\n");
+        return 1;
+    }
+
+    if (opt_watch && opt_append)
+    {
+        fprintf (stderr, "Appended tape can not be updated by `--watch'!\n");
+        return 1;
+    }
+
+    if (opt_manifest)
+    {
+        if (inputs_count || opt_screen)
+        {
+            fprintf (stderr, "Input files are given by manifest!\n");
+            return 1;
+        }
+        /* a missing title is made of the file name of its block */
+        if (opt_title)
+        {
+            fprintf (stderr, "Titles are given by manifest!\n");
+            return 1;
+        }
+        if (opt_tzx || opt_wav || opt_watch || opt_cache_dir)
+        {
+            fprintf (stderr, "Manifest makes only `.tap' tape"
+                " (without `--watch' and `--cache-dir')!\n");
+            return 1;
+        }
+        if (opt_output)
+            return make_manifest_tape (opt_output);
+        if (!opt_auto_name)
+        {
+            fprintf (stderr, "%s %s\n", "No output file specified!", HELP_HINT);
+            return 1;
+        }
+        auto_output_filename (fo_name, opt_manifest, MAX_FILENAME_LEN, DEF_FILE_EXT);
+        return make_manifest_tape (fo_name);
+    }
+
+    /* Check values */
+    if (!inputs_count)
+    {
+        fprintf (stderr, "%s %s\n", "No input file specified!", HELP_HINT);
+        return 1;
+    }
+
+    if (opt_verify || opt_repair)
+        return verify_tapes ();
+
+    if (opt_merge || opt_insert_at != NO_BLOCK || opt_blocks.count || opt_delete.count
+    ||  opt_set_header.block != NO_BLOCK)
+        return edit_tapes ();
+
+    if (opt_list || opt_info || opt_detokenize || opt_extract)
+    {
+        for (n = 0; n < inputs_count; n++)
+            if (inspect_tape (inputs[n]))
+                return 1;
+        return 0;
+    }
+
+    if (!opt_output && !opt_auto_name)
+    {
+        fprintf (stderr, "%s %s\n", "No output file specified!", HELP_HINT);
+        return 1;
+    }
+
+    if (opt_cache_dir && mkdir (opt_cache_dir, 0777) && errno != EEXIST)
+    {
+        fprintf (stderr, "Failed to create cache directory `%s'!\n", opt_cache_dir);
+        return 1;
+    }
+
+    if (opt_screen && read_screen ())
+        return 1;
+
+    get_config (&cfg);
+    if (opt_pack_screen && pack_screen (&cfg))
+        return 1;
+    batch.cfg = &cfg;
+    batch.workers = opt_jobs < inputs_count ? opt_jobs : inputs_count;
+    batch.fo = -1;
+    batch.wav = NULL;
+    batch.fo_name = fo_name;
+    batch.jobs = calloc (inputs_count, sizeof (struct convert_job_t));
+    batch.w = calloc (batch.workers, sizeof (struct convert_worker_t));
+    err = !batch.jobs || !batch.w;
+    for (n = 0; n < batch.workers && !err; n++)
+        err = tap_start_dynamic (&batch.w[n].tape, TAP_FLUSH_SIZE * 2)
+           || !(batch.w[n].chunk = malloc (CHUNK_LEN))
+           || (opt_compress && !(batch.w[n].lz = malloc (sizeof (struct lz_work_t))))
+           || (opt_wav && opt_auto_name && !(batch.w[n].wav = malloc (sizeof (WAVFILE))));
+    /* `.wav' file is rendered from `.tzx' blocks */
+    for (n = 0; n < batch.workers && !err; n++)
+        tap_set_format (&batch.w[n].tape,
+            opt_tzx || opt_wav ? TAP_FORMAT_TZX : TAP_FORMAT_TAP);
+    if (err)
+        fprintf (stderr, "Failed to allocate memory!\n");
+
+    if (!err && opt_watch)
+        err = start_watch (&watch);
+
+    total_start = get_time ();
+
+    /* One combined tape when output filename is given */
+    if (!err && opt_output)
+    {
+        strncpy (fo_name, opt_output, MAX_FILENAME_LEN - 1);
+        fo_name[MAX_FILENAME_LEN - 1] = '\0';
+    }
+
+    /* The combined tape is cached as a whole */
+    if (!err && opt_output && opt_cache_dir)
+    {
+        start_cache_key (&key);
+        for (n = 0; n < inputs_count; n++, total_in += size)
+            if (put_cache_key (&key, inputs[n], &size))
+                break;
+        keyed = n == inputs_count;
+        cached = keyed && !cache_get (opt_cache_dir, &key, fo_name, &total_out);
+        if (!cached)
+            total_in = 0;
+    }
+
+    if (!err && opt_output && !cached)
+    {
+        batch.fo = open_batch_output (fo_name, fo_tmp, sizeof (fo_tmp), &fo_pos);
+        err = batch.fo < 0;
+        if (!err && opt_wav)
+        {
+            batch.wav = malloc (sizeof (WAVFILE));
+            err = !batch.wav;
+            if (err)
+                fprintf (stderr, "Failed to allocate memory!\n");
+            else
+                wav_start (batch.wav, batch.fo, opt_wav_rate);
+        }
+    }
+
+    if (!err && !cached)
+    {
+        err = run_jobs (inputs_count, batch.workers, convert_proc, convert_done, &batch);
+        if (!err && batch.wav && wav_end (batch.wav))
+        {
+            fprintf (stderr, "Failed to save output file `%s'!\n", fo_name);
+            err = 1;
+        }
+    }
+    time = get_time () - total_start;
+    free (batch.wav);
+
+    if (batch.fo >= 0)
+    {
+        err = close_batch_output (batch.fo, fo_tmp, fo_name, fo_pos, err);
+        if (!err && keyed && cache_put (opt_cache_dir, &key, fo_name))
+            fprintf (stderr, "Warning: Failed to put `%s' into cache!\n", fo_name);
+    }
+
+    if (batch.jobs)
+        for (n = 0; n < inputs_count; n++)
+        {
+            total_in += batch.jobs[n].in_size;
+            total_out += batch.jobs[n].out_size;
+        }
+
+    if (!err && opt_stats)
+    {
+        fprintf (stderr, "Total: %u files, %lu -> %lu bytes%s, %.3f ms, %.2f MB/s",
+            inputs_count, total_in, total_out, cached ? " (cached)" : "", time * 1e3,
+            time > 0 ? total_in / time / 1e6 : 0.0);
+        if (opt_wav)
+            fprintf (stderr, ", %.2f Msamples/s", time > 0 ? total_out / time / 1e6 : 0.0);
+        fprintf (stderr, "\n");
+    }
+
+    if (!err && opt_watch)
+        err = watch_inputs (&watch, &cfg, &batch.w[0], batch.jobs,
+            opt_output ? fo_name : NULL);
+    free_watch (&watch);
+
+    if (batch.jobs)
+    {
+        for (n = 0; n < inputs_count; n++)
+            free (batch.jobs[n].data);
+        free (batch.jobs);
+    }
+
+    if (batch.w)
+    {
+        for (n = 0; n < batch.workers; n++)
+        {
+            tap_free (&batch.w[n].tape);
+            free (batch.w[n].chunk);
+            free (batch.w[n].lz);
+            free (batch.w[n].wav);
+        }
+        free (batch.w);
+    }
+
+    return err;
+}
@@ -0,0 +1,269 @@
+/* cache.c - content-addressed cache of output files.
+
+   `cache.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+#define PRIME1  0x9E3779B185EBCA87ULL
+#define PRIME2  0xC2B2AE3D27D4EB4FULL
+#define PRIME3  0x165667B19E3779F9ULL
+
+/* Files which can not be mapped are read by pieces of this size */
+#define READ_LEN    65536
+
+static uint64_t rotl (uint64_t x, unsigned int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/* Final mixing of all bits */
+static uint64_t avalanche (uint64_t x)
+{
+    x ^= x >> 33;
+    x *= PRIME2;
+    x ^= x >> 29;
+    x *= PRIME3;
+    x ^= x >> 32;
+    return x;
+}
+
+void cache_key_init (struct cache_key_t *key)
+{
+    key->h[0] = PRIME1;
+    key->h[1] = PRIME2;
+}
+
+/* Hashes `len' bytes of `data' by two independent lanes of 8 bytes words */
+void cache_key_put (struct cache_key_t *key, const void *data, unsigned long len)
+{
+    const unsigned char *p = data;
+    uint64_t a = key->h[0], b = key->h[1], w0, w1;
+    unsigned long n = len;
+
+    for (; n >= 16; p += 16, n -= 16)
+    {
+        memcpy (&w0, p, 8);
+        memcpy (&w1, p + 8, 8);
+        a = rotl (a + w0 * PRIME2, 31) * PRIME1;
+        b = rotl (b + w1 * PRIME2, 31) * PRIME1;
+    }
+    w0 = w1 = 0;
+    memcpy (&w0, p, n > 8 ? 8 : n);
+    if (n > 8)
+        memcpy (&w1, p + 8, n - 8);
+    a = rotl (a + w0 * PRIME2, 31) * PRIME1;
+    b = rotl (b + w1 * PRIME2, 31) * PRIME1;
+
+    /* the length keeps pieces of data apart */
+    key->h[0] = avalanche (a ^ rotl (b, 17) ^ len);
+    key->h[1] = avalanche (b ^ rotl (a, 43) ^ (len * PRIME3));
+}
+
+void cache_key_put_string (struct cache_key_t *key, const char *s)
+{
+    cache_key_put (key, s, strlen (s));
+}
+
+/* Puts the contents of file `name' into `key'. Returns its size in `size'. */
+char cache_key_put_file (struct cache_key_t *key, const char *name, unsigned long *size)
+{
+    struct stat st;
+    void *map;
+    char *buf;
+    ssize_t len;
+    char err = 1;
+    int fd;
+
+    fd = open (name, O_RDONLY);
+    if (fd < 0)
+        return 1;
+    if (fstat (fd, &st))
+        goto error_exit;
+    *size = st.st_size;
+    if (!st.st_size)
+    {
+        cache_key_put (key, NULL, 0);
+        err = 0;
+        goto error_exit;
+    }
+
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED)
+    {
+        cache_key_put (key, map, st.st_size);
+        munmap (map, st.st_size);
+        err = 0;
+        goto error_exit;
+    }
+
+    /* not a regular file: the pieces make the key */
+    buf = malloc (READ_LEN);
+    if (!buf)
+        goto error_exit;
+    *size = 0;
+    while ((len = read (fd, buf, READ_LEN)) != 0)
+    {
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        cache_key_put (key, buf, len);
+        *size += len;
+    }
+    err = len != 0;
+    free (buf);
+
+error_exit:
+    close (fd);
+    return err;
+}
+
+/* Makes path of entry `key' in `dir' in `dest' (`PATH_MAX' bytes long) */
+static char get_path (char *dest, const char *dir, const struct cache_key_t *key)
+{
+    int len;
+
+    len = snprintf (dest, PATH_MAX, "%s/%016llx%016llx", dir,
+        (unsigned long long) key->h[0], (unsigned long long) key->h[1]);
+    return len < 0 || len >= PATH_MAX;
+}
+
+static char write_all (int fd, const char *buf, unsigned long len)
+{
+    ssize_t n;
+
+    while (len)
+    {
+        n = write (fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Copies file `fi' into `fo' inside the kernel if possible */
+static char copy_fd (int fi, int fo)
+{
+    char buf[READ_LEN];
+    ssize_t len;
+
+    while ((len = copy_file_range (fi, NULL, fo, NULL, 1 << 30, 0)) > 0)
+        ;
+    if (!len)
+        return 0;
+    if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+        return 1;
+
+    /* the rest of file */
+    while ((len = read (fi, buf, READ_LEN)) != 0)
+    {
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        if (write_all (fo, buf, len))
+            return 1;
+    }
+    return 0;
+}
+
+/* Copies file `src' into a new file next to `dest' and renames it to `dest',
+   so `dest' is never seen half written */
+static char copy_file (const char *src, const char *dest)
+{
+    char tmp[PATH_MAX];
+    struct stat st;
+    int fi, fo;
+    char err = 1;
+
+    if (snprintf (tmp, PATH_MAX, "%s.XXXXXX", dest) >= PATH_MAX)
+        return 1;
+    fi = open (src, O_RDONLY);
+    if (fi < 0)
+        return 1;
+    fo = fstat (fi, &st) ? -1 : mkstemp (tmp);
+    if (fo >= 0)
+    {
+        err = copy_fd (fi, fo);
+        /* `mkstemp()' creates the file accessible by owner only */
+        err |= fchmod (fo, st.st_mode & 0777) != 0;
+        err |= close (fo) != 0;
+        if (!err)
+            err = rename (tmp, dest) != 0;
+        if (err)
+            unlink (tmp);
+    }
+    close (fi);
+    return err;
+}
+
+/* Links or copies entry `key' from `dir' to `dest'. Returns 0 and the size of
+   the entry in `size' if it is found. */
+char cache_get (const char *dir, const struct cache_key_t *key, const char *dest,
+    unsigned long *size)
+{
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (get_path (path, dir, key) || stat (path, &st) || !S_ISREG (st.st_mode))
+        return 1;
+    /* the entry is touched to keep the output newer than its inputs */
+    utimensat (AT_FDCWD, path, NULL, 0);
+    if (unlink (dest) && errno != ENOENT)
+        return 1;
+    if (link (path, dest) && copy_file (path, dest))
+        return 1;
+    *size = st.st_size;
+    return 0;
+}
+
+/* Puts file `src' into `dir' as entry `key' */
+char cache_put (const char *dir, const struct cache_key_t *key, const char *src)
+{
+    char path[PATH_MAX];
+
+    if (get_path (path, dir, key))
+        return 1;
+    /* an entry of the same key put by another process is as good */
+    if (!link (src, path) || errno == EEXIST)
+        return 0;
+    return copy_file (src, path);
+}
+
+/* Replaces file `name' by its own copy (or just removes it if `keep' is 0) if
+   it is hard linked (to a cache entry for example), so writing it does not
+   change other files */
+char cache_unshare (const char *name, char keep)
+{
+    struct stat st;
+
+    if (stat (name, &st) || !S_ISREG (st.st_mode) || st.st_nlink < 2)
+        return 0;
+    return keep ? copy_file (name, name) : unlink (name) != 0;
+}
@@ -0,0 +1,38 @@
+/* cache.h - declarations for `cache.c'.
+
+   `cache.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _cache_h
+#define _cache_h 1
+
+#include <stdint.h>
+
+/* Content-addressed cache of output files. An entry is a file in the cache
+   directory named after a 128-bit key made of everything the output depends
+   on (options, names and contents of input files). A cached entry is hard
+   linked to the output file (or copied when linking is not possible), a new
+   output file is linked into the cache the same way. */
+
+#define CACHE_NAME_LEN  32  /* hexadecimal digits of a key */
+
+struct cache_key_t
+{
+    uint64_t h[2];
+};
+
+void cache_key_init (struct cache_key_t *key);
+void cache_key_put (struct cache_key_t *key, const void *data, unsigned long len);
+void cache_key_put_string (struct cache_key_t *key, const char *s);
+char cache_key_put_file (struct cache_key_t *key, const char *name, unsigned long *size);
+char cache_get (const char *dir, const struct cache_key_t *key, const char *dest,
+    unsigned long *size);
+char cache_put (const char *dir, const struct cache_key_t *key, const char *src);
+char cache_unshare (const char *name, char keep);
+
+#endif  /* !_cache_h */
@@ -0,0 +1,154 @@
+/* checksum.c - tape block checksum kernels.
+
+   `checksum.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <stdint.h>
+#include <string.h>
+#if defined (__x86_64__) || defined (__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+#include "checksum.h"
+
+/* Shorter data is processed by scalar code */
+#define MIN_VECTOR_LEN 64
+
+char xor_checksum_scalar (char init, const char *data, unsigned long len)
+{
+    while (len--)
+        init ^= *(data++);
+    return init;
+}
+
+/* Folds all bytes of `x' into one by XOR */
+static char fold64 (uint64_t x)
+{
+    x ^= x >> 32;
+    x ^= x >> 16;
+    x ^= x >> 8;
+    return x;
+}
+
+/* Portable word at a time implementation */
+static char xor_checksum_word (char init, const char *data, unsigned long len)
+{
+    uint64_t a = 0, b = 0, w0, w1;
+
+    for (; len >= 16; data += 16, len -= 16)
+    {
+        memcpy (&w0, data, 8);
+        memcpy (&w1, data + 8, 8);
+        a ^= w0;
+        b ^= w1;
+    }
+    return xor_checksum_scalar (init ^ fold64 (a ^ b), data, len);
+}
+
+#ifdef HAVE_X86
+
+__attribute__((target("sse2")))
+static char xor_checksum_sse2 (char init, const char *data, unsigned long len)
+{
+    __m128i a = _mm_setzero_si128 (), b = _mm_setzero_si128 ();
+    uint64_t w[2];
+
+    if (len < MIN_VECTOR_LEN)
+        return xor_checksum_scalar (init, data, len);
+
+    for (; len >= 32; data += 32, len -= 32)
+    {
+        a = _mm_xor_si128 (a, _mm_loadu_si128 ((const __m128i *) data));
+        b = _mm_xor_si128 (b, _mm_loadu_si128 ((const __m128i *) (data + 16)));
+    }
+    _mm_storeu_si128 ((__m128i *) w, _mm_xor_si128 (a, b));
+    return xor_checksum_word (init ^ fold64 (w[0] ^ w[1]), data, len);
+}
+
+__attribute__((target("avx2")))
+static char xor_checksum_avx2 (char init, const char *data, unsigned long len)
+{
+    __m256i a = _mm256_setzero_si256 (), b = _mm256_setzero_si256 ();
+    __m128i x;
+    uint64_t w[2];
+
+    if (len < MIN_VECTOR_LEN)
+        return xor_checksum_scalar (init, data, len);
+
+    for (; len >= 64; data += 64, len -= 64)
+    {
+        a = _mm256_xor_si256 (a, _mm256_loadu_si256 ((const __m256i *) data));
+        b = _mm256_xor_si256 (b, _mm256_loadu_si256 ((const __m256i *) (data + 32)));
+    }
+    a = _mm256_xor_si256 (a, b);
+    x = _mm_xor_si128 (_mm256_castsi256_si128 (a), _mm256_extracti128_si256 (a, 1));
+    _mm_storeu_si128 ((__m128i *) w, x);
+    return xor_checksum_word (init ^ fold64 (w[0] ^ w[1]), data, len);
+}
+
+#endif  /* HAVE_X86 */
+
+#ifdef HAVE_NEON
+
+static char xor_checksum_neon (char init, const char *data, unsigned long len)
+{
+    uint8x16_t a = vdupq_n_u8 (0), b = vdupq_n_u8 (0);
+    uint64_t w[2];
+
+    if (len < MIN_VECTOR_LEN)
+        return xor_checksum_scalar (init, data, len);
+
+    for (; len >= 32; data += 32, len -= 32)
+    {
+        a = veorq_u8 (a, vld1q_u8 ((const uint8_t *) data));
+        b = veorq_u8 (b, vld1q_u8 ((const uint8_t *) (data + 16)));
+    }
+    vst1q_u8 ((uint8_t *) w, veorq_u8 (a, b));
+    return xor_checksum_word (init ^ fold64 (w[0] ^ w[1]), data, len);
+}
+
+#endif  /* HAVE_NEON */
+
+static char (*xor_checksum_proc) (char, const char *, unsigned long) = xor_checksum_word;
+static const char *xor_checksum_name = "word";
+
+/* Selects implementation once before `main()' (and before any thread starts) */
+__attribute__((constructor))
+static void xor_checksum_init (void)
+{
+#if defined (HAVE_X86)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+    {
+        xor_checksum_proc = xor_checksum_avx2;
+        xor_checksum_name = "avx2";
+    }
+    else if (__builtin_cpu_supports ("sse2"))
+    {
+        xor_checksum_proc = xor_checksum_sse2;
+        xor_checksum_name = "sse2";
+    }
+#elif defined (HAVE_NEON)
+    xor_checksum_proc = xor_checksum_neon;
+    xor_checksum_name = "neon";
+#endif
+}
+
+char xor_checksum (char init, const char *data, unsigned long len)
+{
+    return xor_checksum_proc (init, data, len);
+}
+
+const char *xor_checksum_impl (void)
+{
+    return xor_checksum_name;
+}
@@ -0,0 +1,24 @@
+/* checksum.h - declarations for `checksum.c'.
+
+   `checksum.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _checksum_h
+#define _checksum_h 1
+
+/* Returns `init' XOR-ed with all `len' bytes of `data' (tape block checksum).
+   The fastest implementation supported by CPU is selected at startup. */
+char xor_checksum (char init, const char *data, unsigned long len);
+
+/* Plain byte by byte implementation */
+char xor_checksum_scalar (char init, const char *data, unsigned long len);
+
+/* Name of selected implementation */
+const char *xor_checksum_impl (void);
+
+#endif  /* !_checksum_h */
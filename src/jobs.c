@@ -0,0 +1,154 @@
+/* jobs.c - simple worker pool with ordered completion.
+
+   `jobs.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "jobs.h"
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t finished_cond;
+    pthread_cond_t reported_cond;
+    unsigned int count;
+    unsigned int next;      /* next job to start */
+    unsigned int reported;  /* number of reported jobs */
+    unsigned int window;    /* maximal number of started unreported jobs */
+    char *finished;         /* flags for every job */
+    char stop;
+    job_proc_t proc;
+    void *ctx;
+} JOBS;
+
+typedef struct
+{
+    JOBS *jobs;
+    unsigned int worker;
+    pthread_t thread;
+} WORKER;
+
+void *worker_main (void *arg)
+{
+    WORKER *self = arg;
+    JOBS *jobs = self->jobs;
+    unsigned int index;
+
+    for (;;)
+    {
+        pthread_mutex_lock (&jobs->lock);
+        while (!jobs->stop && jobs->next < jobs->count
+        &&  jobs->next - jobs->reported >= jobs->window)
+            pthread_cond_wait (&jobs->reported_cond, &jobs->lock);
+        if (jobs->stop || jobs->next == jobs->count)
+        {
+            pthread_mutex_unlock (&jobs->lock);
+            break;
+        }
+        index = jobs->next++;
+        pthread_mutex_unlock (&jobs->lock);
+
+        jobs->proc (jobs->ctx, index, self->worker);
+
+        pthread_mutex_lock (&jobs->lock);
+        jobs->finished[index] = 1;
+        pthread_cond_signal (&jobs->finished_cond);
+        pthread_mutex_unlock (&jobs->lock);
+    }
+    return NULL;
+}
+
+char run_jobs (unsigned int count, unsigned int workers,
+    job_proc_t proc, job_done_t done, void *ctx)
+{
+    JOBS jobs;
+    WORKER *w;
+    unsigned int i, started;
+    char err = 0;
+
+    if (workers > count)
+        workers = count;
+
+    /* no threads for a single worker */
+    if (workers <= 1)
+    {
+        for (i = 0; i < count && !err; i++)
+        {
+            proc (ctx, i, 0);
+            err = done (ctx, i);
+        }
+        return err;
+    }
+
+    jobs.finished = calloc (count, 1);
+    w = malloc (sizeof (WORKER) * workers);
+    if (!jobs.finished || !w)
+    {
+        fprintf (stderr, "Failed to allocate memory!\n");
+        free (jobs.finished);
+        free (w);
+        return 1;
+    }
+    pthread_mutex_init (&jobs.lock, NULL);
+    pthread_cond_init (&jobs.finished_cond, NULL);
+    pthread_cond_init (&jobs.reported_cond, NULL);
+    jobs.count = count;
+    jobs.next = 0;
+    jobs.reported = 0;
+    jobs.window = workers * JOBS_AHEAD;
+    jobs.stop = 0;
+    jobs.proc = proc;
+    jobs.ctx = ctx;
+
+    for (started = 0; started < workers; started++)
+    {
+        w[started].jobs = &jobs;
+        w[started].worker = started;
+        if (pthread_create (&w[started].thread, NULL, worker_main, &w[started]))
+            break;
+    }
+    if (!started)
+    {
+        fprintf (stderr, "Failed to start worker threads!\n");
+        err = 1;
+    }
+
+    /* report finished jobs in order */
+    for (i = 0; i < count && !err; i++)
+    {
+        pthread_mutex_lock (&jobs.lock);
+        while (!jobs.finished[i])
+            pthread_cond_wait (&jobs.finished_cond, &jobs.lock);
+        pthread_mutex_unlock (&jobs.lock);
+        err = done (ctx, i);
+
+        pthread_mutex_lock (&jobs.lock);
+        jobs.reported = i + 1;
+        pthread_cond_broadcast (&jobs.reported_cond);
+        pthread_mutex_unlock (&jobs.lock);
+    }
+
+    if (err)
+    {
+        pthread_mutex_lock (&jobs.lock);
+        jobs.stop = 1;
+        pthread_cond_broadcast (&jobs.reported_cond);
+        pthread_mutex_unlock (&jobs.lock);
+    }
+    for (i = 0; i < started; i++)
+        pthread_join (w[i].thread, NULL);
+
+    pthread_cond_destroy (&jobs.reported_cond);
+    pthread_cond_destroy (&jobs.finished_cond);
+    pthread_mutex_destroy (&jobs.lock);
+    free (jobs.finished);
+    free (w);
+    return err;
+}
@@ -0,0 +1,31 @@
+/* jobs.h - declarations for `jobs.c'.
+
+   `jobs.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _jobs_h
+#define _jobs_h 1
+
+#define MAX_WORKERS 256
+
+/* Number of jobs started but not yet reported per worker. Results of finished
+   jobs wait to be reported in order, so workers never run further ahead. */
+#define JOBS_AHEAD  2
+
+/* Called in a worker thread for job number `index'.
+   `worker' is the number of the calling worker in range [0; workers). */
+typedef void (*job_proc_t) (void *ctx, unsigned int index, unsigned int worker);
+
+/* Called in the calling thread for every finished job strictly in order of
+   jobs' numbers. Returning non-zero stops processing of remaining jobs. */
+typedef char (*job_done_t) (void *ctx, unsigned int index);
+
+char run_jobs (unsigned int count, unsigned int workers,
+    job_proc_t proc, job_done_t done, void *ctx);
+
+#endif  /* !_jobs_h */
@@ -0,0 +1,661 @@
+/* libbintap.c - re-entrant binary to `.tap' conversion library.
+
+   `libbintap.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <string.h>
+#include "tapfile.h"
+#include "basic.h"
+#include "turbo.h"
+#include "lzpack.h"
+#include "libbintap.h"
+
+void bintap_init_config (struct bintap_config_t *cfg)
+{
+    cfg->program = 0;
+    cfg->basic = 0;
+    cfg->d80_syntax = 0;
+    cfg->print_headers = 1;
+    cfg->fast_numbers = 0;
+    cfg->start_line = BINTAP_DEF_START_LINE;
+    cfg->load_address = BINTAP_DEF_LOAD_ADDR;
+    cfg->extra_address = BINTAP_DEF_EXTRA_ADDR;
+    cfg->clear_address = BINTAP_DEF_CLEAR_ADDR;
+    cfg->exec_address = BINTAP_DEF_EXEC_ADDR;
+    cfg->border_color = BINTAP_DEF_BORDER_COL;
+    cfg->paper_color = BINTAP_DEF_PAPER_COL;
+    cfg->ink_color = BINTAP_DEF_INK_COL;
+    cfg->chunk_size = 0;
+    memset (cfg->chunk_address, 0, sizeof (cfg->chunk_address));
+    cfg->turbo = 0;
+    tzx_init_timing (&cfg->timing);
+    cfg->screen = NULL;
+    cfg->screen_size = 0;
+    cfg->screen_address = 0;
+    cfg->screen_layout = BINTAP_SCREEN_WHOLE;
+}
+
+const char *bintap_strerror (int err)
+{
+    switch (err)
+    {
+    case BINTAP_OK:
+        return "Success";
+    case BINTAP_ERR_ARG:
+        return "Invalid argument";
+    case BINTAP_ERR_EMPTY:
+        return "No data";
+    case BINTAP_ERR_TOO_LONG:
+        return "Data is too long";
+    case BINTAP_ERR_NO_SPACE:
+        return "Output buffer is too small";
+    case BINTAP_ERR_WRITE:
+        return "Failed to write output file";
+    case BINTAP_ERR_ADDRESS:
+        return "Data does not fit into memory";
+    default:
+        return "Unknown error";
+    }
+}
+
+/* Returns maximal size of data accepted with settings `cfg' */
+unsigned int bintap_get_max_size (const struct bintap_config_t *cfg)
+{
+    if (cfg->chunk_size && !cfg->program)
+        return cfg->chunk_size * BINTAP_MAX_CHUNKS;
+    return BINTAP_MAX_DATA_LEN;
+}
+
+/* Returns the number of data blocks for `size' bytes in `blocks' and their
+   addresses and lengths in `list' (the first one is loaded at `addr') */
+static int get_blocks (const struct bintap_config_t *cfg, unsigned int size,
+    unsigned int addr, struct turbo_block_t *list, unsigned int *blocks)
+{
+    unsigned int chunk, i, n;
+
+    if (!size)
+        return BINTAP_ERR_EMPTY;
+    if (cfg->chunk_size > BINTAP_MAX_DATA_LEN || (cfg->chunk_size && cfg->program))
+        return BINTAP_ERR_ARG;
+    if (cfg->turbo && cfg->basic
+    &&  (cfg->d80_syntax || turbo_check_timing (&cfg->timing)))
+        return BINTAP_ERR_ARG;
+    if (size > bintap_get_max_size (cfg))
+        return BINTAP_ERR_TOO_LONG;
+
+    chunk = cfg->chunk_size ? cfg->chunk_size : size;
+    n = (size + chunk - 1) / chunk;
+    for (i = 0; i < n; i++)
+    {
+        if (i && cfg->chunk_address[i])
+            addr = cfg->chunk_address[i];
+        list[i].address = addr;
+        list[i].length = i < n - 1 ? chunk : size - i * chunk;
+        /* only split data is checked to keep a single block as is */
+        if (cfg->chunk_size && addr + list[i].length > BINTAP_MAX_ADDR + 1)
+            return BINTAP_ERR_ADDRESS;
+        addr += list[i].length;
+    }
+    if (cfg->turbo && cfg->basic
+    &&  turbo_check_blocks (list, n, cfg->clear_address))
+        return BINTAP_ERR_ADDRESS;
+    *blocks = n;
+    return BINTAP_OK;
+}
+
+/* Prebuilt parts of BASIC loader which do not depend on settings. A loader is
+   made of them by copying with numbers and names stored between. */
+static const char loader_rem[] = SYM_REM;
+static const char loader_title[] = "loader by " BINTAP_NAME "-" BINTAP_VERSION;
+static const char loader_paper[] = ":" SYM_PAPER;
+static const char loader_ink[] = ":" SYM_INK;
+static const char loader_bright[] = ":" SYM_BRIGHT;
+static const char loader_flash[] = ":" SYM_FLASH;
+static const char loader_inverse[] = ":" SYM_INVERSE;
+static const char loader_cls[] = ":" SYM_CLS;
+static const char loader_clear[] = SYM_CLEAR;
+static const char loader_load[] = SYM_LOAD "\"";
+static const char loader_load_d80[] = SYM_LOAD "*\"";
+static const char loader_code[] = "\"" SYM_CODE;
+static const char loader_screen[] = "\"" SYM_SCREEN;
+static const char loader_usr[] = SYM_RANDOMIZE SYM_USR;
+
+/* Copies a prebuilt part `s' to `p' */
+#define PUT_PART(p, s) (memcpy ((p), (s), sizeof (s) - 1), (p) += sizeof (s) - 1)
+
+/* Makes `make_loader()' fail when `n' bytes do not fit at `p' before `end' */
+#define NEED_ROOM(p, n) \
+    do { if ((unsigned int) (end - (p)) < (n)) return 0; } while (0)
+
+/* Room for ending a line and starting the next one */
+#define LINE_ROOM   (1 + 4)
+
+static char *put_string (char *p, const char *s, unsigned int len)
+{
+    memcpy (p, s, len);
+    return p + len;
+}
+
+/* Puts number `n' in the cheapest form by cost model of `cfg' */
+static char *put_number (char *p, const struct bintap_config_t *cfg, unsigned int n)
+{
+    return p + bas_make_int (p, n,
+        cfg->fast_numbers ? BAS_COST_TIME : BAS_COST_SIZE);
+}
+
+/* Starts line `num' at `p'. Returns the start of its text. */
+static char *start_line (char *p, unsigned int num)
+{
+    p[0] = num / 256;
+    p[1] = num % 256;
+    return p + 4;
+}
+
+/* Ends the line of text started at `text' with `p' pointing after it. Returns
+   the start of the next line. */
+static char *end_line (char *text, char *p)
+{
+    unsigned int len;
+
+    *p++ = LEX_CR;
+    len = p - text;
+    text[-2] = len % 256;
+    text[-1] = len / 256;
+    return p;
+}
+
+/* Generates BASIC loader program doing `count' `steps' into `buf'
+   (`BINTAP_MAX_LOADER_LEN' bytes long). Loading steps share a line, each call
+   gets its own line. With turbo speed blocks the code of turbo loader loading
+   blocks of `list' and calling `exec' is put into REM statement of the first
+   line and called after the steps. Returns the length of the program or 0 if
+   it does not fit into `buf'. The loader is copied from prebuilt parts, only
+   numbers and names are stored between. */
+static unsigned int make_loader (const struct bintap_config_t *cfg,
+    const struct bintap_step_t *steps, unsigned int count,
+    const struct turbo_block_t *list, unsigned int blocks, unsigned int exec,
+    char *buf)
+{
+    unsigned int num = BINTAP_LINE_START, i, len;
+    char *line, *p, *end = buf + BINTAP_MAX_LOADER_LEN;
+
+    /* the first three lines and the last one are short, numbers are the
+       longest parts of them */
+    line = p = start_line (buf, num);
+    PUT_PART (p, loader_rem);
+    if (cfg->turbo)
+    {
+        NEED_ROOM (p, TURBO_MAX_LEN (blocks));
+        p += turbo_make_loader (p, &cfg->timing, list, blocks, exec, cfg->clear_address);
+    }
+    NEED_ROOM (p, sizeof (loader_title) + LINE_ROOM + 1 + BAS_MAX_INT_LEN * 6
+        + sizeof (loader_paper) + sizeof (loader_ink) + sizeof (loader_bright)
+        + sizeof (loader_flash) + sizeof (loader_inverse) + sizeof (loader_cls)
+        + LINE_ROOM + sizeof (loader_clear) + BAS_MAX_INT_LEN + LINE_ROOM
+        + 1 + BAS_MAX_INT_LEN * 2 + LINE_ROOM);
+    PUT_PART (p, loader_title);
+    p = end_line (line, p);
+
+    line = p = start_line (p, num += BINTAP_LINE_INC);
+    *p++ = LEX_BORDER;
+    p = put_number (p, cfg, cfg->border_color);
+    PUT_PART (p, loader_paper);
+    p = put_number (p, cfg, cfg->paper_color);
+    PUT_PART (p, loader_ink);
+    p = put_number (p, cfg, cfg->ink_color);
+    PUT_PART (p, loader_bright);
+    p = put_number (p, cfg, 0);
+    PUT_PART (p, loader_flash);
+    p = put_number (p, cfg, 0);
+    PUT_PART (p, loader_inverse);
+    p = put_number (p, cfg, 0);
+    PUT_PART (p, loader_cls);
+    p = end_line (line, p);
+
+    line = p = start_line (p, num += BINTAP_LINE_INC);
+    PUT_PART (p, loader_clear);
+    p = put_number (p, cfg, cfg->clear_address);
+    p = end_line (line, p);
+
+    /* only ROM loading prints headers */
+    if (count && !cfg->print_headers)
+    {
+        line = p = start_line (p, num += BINTAP_LINE_INC);
+        /* POKE 23739,111 */
+        *p++ = LEX_POKE;
+        p = put_number (p, cfg, 23739);
+        *p++ = ',';
+        p = put_number (p, cfg, 111);
+        p = end_line (line, p);
+    }
+
+    line = NULL;
+    for (i = 0; i < count; i++)
+    {
+        len = steps[i].type == BINTAP_STEP_CALL ? 0 : strlen (steps[i].name);
+        NEED_ROOM (p, LINE_ROOM + sizeof (loader_load_d80) + len
+            + sizeof (loader_screen) + sizeof (loader_usr) + BAS_MAX_INT_LEN + 1);
+        if (line && steps[i].type == BINTAP_STEP_CALL)
+        {
+            p = end_line (line, p);
+            line = NULL;
+        }
+        if (line)
+            *p++ = ':';
+        else
+            line = p = start_line (p, num += BINTAP_LINE_INC);
+        if (steps[i].type == BINTAP_STEP_CALL)
+        {
+            PUT_PART (p, loader_usr);
+            p = put_number (p, cfg, steps[i].address);
+            p = end_line (line, p);
+            line = NULL;
+        }
+        else
+        {
+            if (cfg->d80_syntax)
+                PUT_PART (p, loader_load_d80);
+            else
+                PUT_PART (p, loader_load);
+            p = put_string (p, steps[i].name, len);
+            if (steps[i].type == BINTAP_STEP_SCREEN)
+                PUT_PART (p, loader_screen);
+            else
+                PUT_PART (p, loader_code);
+        }
+    }
+    if (line)
+        p = end_line (line, p);
+
+    if (cfg->turbo)
+    {
+        /* the loader jumps to `exec' itself */
+        NEED_ROOM (p, LINE_ROOM + sizeof (loader_usr) + BAS_MAX_INT_LEN);
+        line = p = start_line (p, num += BINTAP_LINE_INC);
+        PUT_PART (p, loader_usr);
+        p = put_number (p, cfg, TURBO_LOADER_ADDR);
+        p = end_line (line, p);
+    }
+
+    return p - buf;
+}
+
+static int get_tape_error (TAPFILE *tape)
+{
+    switch (tap_get_error (tape))
+    {
+    case 0:
+        return BINTAP_OK;
+    case TAP_ERR_NO_SPACE:
+        return BINTAP_ERR_NO_SPACE;
+    case TAP_ERR_WRITE:
+        return BINTAP_ERR_WRITE;
+    default:
+        return BINTAP_ERR_ARG;
+    }
+}
+
+static void put_program (TAPFILE *tape, char *name, char *data, unsigned int len)
+{
+    /* new block */
+    tap_new_block (tape);
+    tap_put_char (tape, TAP_BLK_HEADER);
+    tap_put_program_header (tape, name, len, BINTAP_LINE_RUN, len);
+    tap_end_block (tape);
+
+    /* new block */
+    tap_new_block (tape);
+    tap_put_char (tape, TAP_BLK_DATA);
+    tap_put_data (tape, data, len);
+    tap_end (tape);
+}
+
+static void put_header (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, unsigned int size, unsigned int addr)
+{
+    /* new block */
+    tap_new_block (tape);
+    tap_put_char (tape, TAP_BLK_HEADER);
+    if (cfg->program)
+        tap_put_program_header (tape, name, size, cfg->start_line, size);
+    else
+        tap_put_bytes_header (tape, name, size, addr, cfg->extra_address);
+    tap_end_block (tape);
+}
+
+/* Puts steps loading the screen of `cfg' named `name' into `steps'. Returns
+   the number of steps. */
+static unsigned int get_screen_steps (const struct bintap_config_t *cfg,
+    char *name, struct bintap_step_t *steps)
+{
+    if (!cfg->screen)
+        return 0;
+    steps[0].type = BINTAP_STEP_LOAD;
+    steps[0].name = name;
+    steps[1] = steps[0];
+    switch (cfg->screen_layout)
+    {
+    case BINTAP_SCREEN_ATTRS:
+        return 2;
+    case BINTAP_SCREEN_PACKED:
+        /* the depacker is in front of the packed stream */
+        steps[1].type = BINTAP_STEP_CALL;
+        steps[1].address = cfg->screen_address;
+        return 2;
+    default:
+        steps[0].type = BINTAP_STEP_SCREEN;
+        return 1;
+    }
+}
+
+/* Puts loader loading the screen and `blocks' blocks named `data_name' and
+   calling `exec'. Names are at most `TAP_HEADER_NAME_LEN' long. */
+static int put_loader (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *basic_name, char *data_name, const struct turbo_block_t *list,
+    unsigned int blocks, unsigned int exec)
+{
+    struct bintap_step_t steps[BINTAP_MAX_STEPS];
+    char buf[BINTAP_MAX_LOADER_LEN];
+    unsigned int count, i, len;
+
+    if (!tape || !cfg || !basic_name || !data_name
+    ||  strlen (basic_name) > TAP_HEADER_NAME_LEN
+    ||  strlen (data_name) > TAP_HEADER_NAME_LEN
+    ||  !blocks || blocks > BINTAP_MAX_CHUNKS)
+        return BINTAP_ERR_ARG;
+    count = get_screen_steps (cfg, data_name, steps);
+    /* turbo loader loads the blocks itself */
+    if (!cfg->turbo)
+    {
+        for (i = 0; i < blocks; i++)
+        {
+            steps[count].type = BINTAP_STEP_LOAD;
+            steps[count++].name = data_name;
+        }
+        steps[count].type = BINTAP_STEP_CALL;
+        steps[count++].address = exec;
+    }
+    len = make_loader (cfg, steps, count, list, blocks, exec, buf);
+    if (!len)
+        return BINTAP_ERR_TOO_LONG;
+    put_program (tape, basic_name, buf, len);
+    return get_tape_error (tape);
+}
+
+/* Puts `Bytes' header and data block of `len' bytes of `data' loaded at
+   `addr' at standard speed */
+static void put_bytes (TAPFILE *tape, char *name, const char *data,
+    unsigned int len, unsigned int addr)
+{
+    /* new block */
+    tap_new_block (tape);
+    tap_put_char (tape, TAP_BLK_HEADER);
+    tap_put_bytes_header (tape, name, len, addr, BINTAP_DEF_EXTRA_ADDR);
+    tap_end_block (tape);
+
+    tap_put_block (tape, TAP_BLK_DATA, data, len);
+}
+
+/* Puts blocks of the screen of `cfg' named `name' */
+static void put_screen (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name)
+{
+    const char *s = cfg->screen;
+
+    switch (cfg->screen_layout)
+    {
+    case BINTAP_SCREEN_ATTRS:
+        put_bytes (tape, name, s + BINTAP_SCREEN_PIXELS,
+            BINTAP_SCREEN_LEN - BINTAP_SCREEN_PIXELS,
+            BINTAP_SCREEN_ADDR + BINTAP_SCREEN_PIXELS);
+        put_bytes (tape, name, s, BINTAP_SCREEN_PIXELS, BINTAP_SCREEN_ADDR);
+        break;
+    case BINTAP_SCREEN_PACKED:
+        put_bytes (tape, name, s, cfg->screen_size, cfg->screen_address);
+        break;
+    default:
+        put_bytes (tape, name, s, BINTAP_SCREEN_LEN, BINTAP_SCREEN_ADDR);
+    }
+}
+
+/* Packs `screen' (`BINTAP_SCREEN_LEN' bytes) into `work->out' and sets it as
+   the screen of `cfg'. The packed screen follows its depacker, which returns
+   to BASIC, and is loaded right above `cfg->clear_address', so it is
+   overwritten by the code loaded after it. The screen is kept as is if
+   packing gives no gain. */
+int bintap_pack_screen (struct bintap_config_t *cfg, const char *screen,
+    struct lz_work_t *work)
+{
+    unsigned int len, gap, addr;
+
+    if (!cfg || !screen || !work)
+        return BINTAP_ERR_ARG;
+    cfg->screen = screen;
+    cfg->screen_size = BINTAP_SCREEN_LEN;
+    cfg->screen_layout = BINTAP_SCREEN_WHOLE;
+
+    len = lz_pack (work, screen, BINTAP_SCREEN_LEN, work->out + LZ_DEPACKER_LEN, &gap);
+    if (!len || len + LZ_DEPACKER_LEN >= BINTAP_SCREEN_LEN)
+        return BINTAP_OK;
+    addr = cfg->clear_address + 1;
+    if (addr < BINTAP_SCREEN_ADDR + BINTAP_SCREEN_LEN
+    ||  addr + LZ_DEPACKER_LEN + len > BINTAP_MAX_ADDR + 1)
+        return BINTAP_ERR_ADDRESS;
+    memset (work->out, 0, LZ_DEPACKER_LEN);
+    lz_make_depacker (work->out, addr + LZ_DEPACKER_LEN, BINTAP_SCREEN_ADDR, LZ_EXIT_RET);
+    cfg->screen = work->out;
+    cfg->screen_size = LZ_DEPACKER_LEN + len;
+    cfg->screen_address = addr;
+    cfg->screen_layout = BINTAP_SCREEN_PACKED;
+    return BINTAP_OK;
+}
+
+/* Puts a data block (turbo speed one if needed) */
+static void put_data (TAPFILE *tape, const struct bintap_config_t *cfg,
+    const char *data, unsigned int len)
+{
+    tap_set_timing (tape, cfg->turbo ? &cfg->timing : NULL);
+    tap_put_block (tape, TAP_BLK_DATA, data, len);
+    tap_set_timing (tape, NULL);
+}
+
+/* Puts a header of data block unless it is loaded by turbo loader */
+static void put_data_header (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, unsigned int size, unsigned int addr)
+{
+    if (!(cfg->turbo && cfg->basic))
+        put_header (tape, cfg, name, size, addr);
+}
+
+/* Appends BASIC loader for `blocks' data blocks named `data_name' to `tape'.
+   Turbo loader needs addresses of blocks, so it is made by `bintap_put_file()'
+   only. The loader loads the screen of `cfg' first, but its blocks are not
+   put. Names are at most `TAP_HEADER_NAME_LEN' long. */
+int bintap_put_loader (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *basic_name, char *data_name, unsigned int blocks)
+{
+    if (!cfg || cfg->turbo)
+        return BINTAP_ERR_ARG;
+    return put_loader (tape, cfg, basic_name, data_name, NULL, blocks,
+        cfg->exec_address);
+}
+
+/* Appends BASIC loader doing `count' `steps' to `tape'. Names of blocks to
+   load are at most `TAP_HEADER_NAME_LEN' long (empty to load any block). */
+int bintap_put_steps_loader (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *basic_name, const struct bintap_step_t *steps, unsigned int count)
+{
+    char buf[BINTAP_MAX_LOADER_LEN];
+    unsigned int i, len;
+
+    if (!tape || !cfg || !basic_name || !steps || cfg->turbo
+    ||  count > BINTAP_MAX_STEPS)
+        return BINTAP_ERR_ARG;
+    for (i = 0; i < count; i++)
+        if (steps[i].type != BINTAP_STEP_CALL
+        &&  (!steps[i].name || strlen (steps[i].name) > TAP_HEADER_NAME_LEN))
+            return BINTAP_ERR_ARG;
+    len = make_loader (cfg, steps, count, NULL, 0, 0, buf);
+    if (!len)
+        return BINTAP_ERR_TOO_LONG;
+    put_program (tape, basic_name, buf, len);
+    return get_tape_error (tape);
+}
+
+/* Puts loader calling `exec' if needed. Returns the number of data blocks in
+   `blocks' and their addresses in `list' (the first one is at `addr'). */
+static int put_prologue (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, unsigned int size, unsigned int addr, unsigned int exec,
+    struct turbo_block_t *list, unsigned int *blocks)
+{
+    int err;
+
+    if (!tape || !cfg || !name)
+        return BINTAP_ERR_ARG;
+    err = get_blocks (cfg, size, addr, list, blocks);
+    if (err)
+        return err;
+
+    if (cfg->screen && cfg->program)
+        return BINTAP_ERR_ARG;
+
+    if ((!cfg->program) && (cfg->basic))
+    {
+        if (cfg->d80_syntax)
+            err = put_loader (tape, cfg, "run", name, list, *blocks, exec);
+        else
+            err = put_loader (tape, cfg, name, name, list, *blocks, exec);
+    }
+    if (!err && cfg->screen)
+    {
+        put_screen (tape, cfg, name);
+        err = get_tape_error (tape);
+    }
+    return err;
+}
+
+/* Appends optional BASIC loader, header and data blocks to `tape'. Data
+   longer than `cfg->chunk_size' is split into several blocks.
+   When streaming `data' is written to output file without copying. With the
+   loader `name' is at most `TAP_HEADER_NAME_LEN' long. */
+int bintap_put_file (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, const char *data, unsigned int size)
+{
+    struct turbo_block_t list[BINTAP_MAX_CHUNKS];
+    unsigned int blocks, i;
+    int err;
+
+    if (!data)
+        return BINTAP_ERR_ARG;
+    err = put_prologue (tape, cfg, name, size, cfg->load_address, cfg->exec_address,
+        list, &blocks);
+    if (err)
+        return err;
+
+    for (i = 0; i < blocks; i++)
+    {
+        put_data_header (tape, cfg, name, list[i].length, list[i].address);
+        put_data (tape, cfg, data, list[i].length);
+        data += list[i].length;
+    }
+    return bintap_end_file (tape);
+}
+
+/* Appends optional BASIC loader and header block to `tape' and starts the data
+   block of `size' bytes. The data must be passed by `tap_stream_data()' and
+   followed by `bintap_end_file()'. The data is never split, so `size' must not
+   exceed `cfg->chunk_size'. */
+int bintap_begin_file (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, unsigned int size)
+{
+    struct turbo_block_t list[BINTAP_MAX_CHUNKS];
+    unsigned int blocks;
+    int err;
+
+    err = put_prologue (tape, cfg, name, size, cfg->load_address, cfg->exec_address,
+        list, &blocks);
+    if (err)
+        return err;
+    if (blocks > 1)
+        return BINTAP_ERR_TOO_LONG;
+    put_data_header (tape, cfg, name, size, cfg->load_address);
+    tap_set_timing (tape, cfg->turbo ? &cfg->timing : NULL);
+    tap_begin_block (tape, TAP_BLK_DATA, size);
+    return get_tape_error (tape);
+}
+
+/* Appends optional BASIC loader, header and data block with packed `data'
+   unpacked to `cfg->load_address' by the attached Z80 depacker, which then
+   jumps to `cfg->exec_address'. The loader calls the depacker instead of
+   `cfg->exec_address'. `work->packed_len' receives the length of the data block
+   or 0 if packing gives no gain and the data is stored as is. */
+int bintap_put_packed_file (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, const char *data, unsigned int size, struct lz_work_t *work)
+{
+    struct turbo_block_t list[BINTAP_MAX_CHUNKS];
+    unsigned int blocks, gap, len, addr;
+    int err;
+
+    if (!cfg || !data || !work || cfg->program || cfg->chunk_size)
+        return BINTAP_ERR_ARG;
+    if (size > LZ_MAX_LEN)
+        return BINTAP_ERR_TOO_LONG;
+
+    len = size ? lz_pack (work, data, size, work->out, &gap) : 0;
+    if (!len || len + LZ_DEPACKER_LEN >= size)
+    {
+        work->packed_len = 0;
+        return bintap_put_file (tape, cfg, name, data, size);
+    }
+
+    /* stream is loaded above the destination by `gap' bytes */
+    addr = cfg->load_address + gap;
+    if (addr + len + LZ_DEPACKER_LEN > BINTAP_MAX_ADDR + 1)
+        return BINTAP_ERR_ADDRESS;
+    lz_make_depacker (work->out + len, addr, cfg->load_address, cfg->exec_address);
+    len += LZ_DEPACKER_LEN;
+    work->packed_len = len;
+
+    err = put_prologue (tape, cfg, name, len, addr, addr + len - LZ_DEPACKER_LEN,
+        list, &blocks);
+    if (err)
+        return err;
+    put_data_header (tape, cfg, name, len, addr);
+    put_data (tape, cfg, work->out, len);
+    return bintap_end_file (tape);
+}
+
+/* Finishes the tape and writes it out when streaming */
+int bintap_end_file (TAPFILE *tape)
+{
+    if (!tape)
+        return BINTAP_ERR_ARG;
+    tap_end (tape);
+    tap_set_timing (tape, NULL);
+    return get_tape_error (tape);
+}
+
+/* Makes a complete tape from `size' bytes of `data' in `buf' of `buf_size' bytes.
+   `BINTAP_MAX_TAPE_LEN(size)' bytes are always enough. */
+int bintap_convert (const struct bintap_config_t *cfg, char *name,
+    const char *data, unsigned int size,
+    char *buf, unsigned int buf_size, unsigned int *tape_size)
+{
+    TAPFILE tape;
+    int err;
+
+    if (!buf || !tape_size)
+        return BINTAP_ERR_ARG;
+
+    tap_start (&tape, buf, buf_size);
+    err = bintap_put_file (&tape, cfg, name, data, size);
+    if (err)
+        return err;
+    *tape_size = tap_get_size (&tape);
+    return BINTAP_OK;
+}
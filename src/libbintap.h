@@ -0,0 +1,140 @@
+/* libbintap.h - declarations for `libbintap.c'.
+
+   `libbintap.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _libbintap_h
+#define _libbintap_h 1
+
+#include "tapfile.h"
+#include "tzxfile.h"
+#include "lzpack.h"
+
+#define BINTAP_NAME     "bintap"
+#define BINTAP_VERSION  "1.0"
+
+/* Limits */
+#define BINTAP_MAX_LOADER_LEN   1024
+#define BINTAP_MAX_DATA_LEN     49152
+#define BINTAP_MAX_CHUNKS       32
+#define BINTAP_MAX_LINE         9999
+#define BINTAP_MAX_ADDR         65535
+#define BINTAP_MAX_COL          7
+
+/* Maximal size of a tape made from `n' bytes of data */
+#define BINTAP_MAX_TAPE_LEN(n) \
+    ((sizeof (struct tap_block_header_t) + 4 + 4) * (BINTAP_MAX_CHUNKS + 3) \
+    + BINTAP_MAX_LOADER_LEN + BINTAP_SCREEN_LEN + (n))
+
+/* Screen */
+#define BINTAP_SCREEN_ADDR      16384
+#define BINTAP_SCREEN_LEN       6912
+#define BINTAP_SCREEN_PIXELS    6144    /* attributes follow the pixels */
+
+/* Screen layout on tape */
+#define BINTAP_SCREEN_WHOLE     0   /* one block loaded by LOAD "" SCREEN$ */
+#define BINTAP_SCREEN_ATTRS     1   /* attributes block before pixels block */
+#define BINTAP_SCREEN_PACKED    2   /* packed block unpacked by USR */
+
+/* Default values */
+#define BINTAP_DEF_START_LINE   32768
+#define BINTAP_DEF_LOAD_ADDR    32768
+#define BINTAP_DEF_EXTRA_ADDR   32768
+#define BINTAP_DEF_CLEAR_ADDR   24575
+#define BINTAP_DEF_EXEC_ADDR    32768
+#define BINTAP_DEF_BORDER_COL   0
+#define BINTAP_DEF_PAPER_COL    0
+#define BINTAP_DEF_INK_COL      7
+
+/* Internal BASIC loader generator */
+#define BINTAP_LINE_START   10
+#define BINTAP_LINE_INC     10
+#define BINTAP_LINE_RUN     20
+
+/* Step of BASIC loader made by `bintap_put_steps_loader()' */
+#define BINTAP_MAX_STEPS    (BINTAP_MAX_CHUNKS + 3)
+#define BINTAP_STEP_LOAD    0   /* LOAD "name" CODE */
+#define BINTAP_STEP_CALL    1   /* RANDOMIZE USR address */
+#define BINTAP_STEP_SCREEN  2   /* LOAD "name" SCREEN$ */
+struct bintap_step_t
+{
+    char type;
+    char *name;                 /* of block to load */
+    unsigned int address;       /* to call */
+};
+
+/* Error codes */
+#define BINTAP_OK           0
+#define BINTAP_ERR_ARG      1   /* invalid argument */
+#define BINTAP_ERR_EMPTY    2   /* no data */
+#define BINTAP_ERR_TOO_LONG 3   /* data is too long */
+#define BINTAP_ERR_NO_SPACE 4   /* output buffer is too small */
+#define BINTAP_ERR_WRITE    5   /* failed to write output file */
+#define BINTAP_ERR_ADDRESS  6   /* data block does not fit into memory */
+
+/* Conversion settings. Never modified by the library, so one structure may be
+   shared by any number of threads. */
+struct bintap_config_t
+{
+    char program;           /* make `Program' instead of `Bytes' */
+    char basic;             /* include BASIC loader */
+    char d80_syntax;        /* create D80 syntax loader */
+    char print_headers;     /* show header title when loading */
+    char fast_numbers;      /* numbers of loader are fastest interpreted
+                               instead of shortest */
+    unsigned int start_line;
+    unsigned int load_address;
+    unsigned int extra_address;
+    unsigned int clear_address;
+    unsigned int exec_address;
+    char border_color;
+    char paper_color;
+    char ink_color;
+    /* Data longer than `chunk_size' (if not 0) is split into several `Bytes'
+       blocks loaded at `chunk_address[]' (0 - right after the previous block,
+       the first block is loaded at `load_address') */
+    unsigned int chunk_size;
+    unsigned int chunk_address[BINTAP_MAX_CHUNKS];
+    /* Data blocks of `.tzx' tape are turbo speed blocks with `timing'. They
+       can not be loaded by ROM, so BASIC loader has Z80 turbo loader (see
+       `turbo.h') and the blocks have no headers then. */
+    char turbo;
+    struct tzx_timing_t timing;
+    /* Screen of `BINTAP_SCREEN_LEN' bytes (or NULL) put in front of data
+       blocks (with headers and at standard speed) and loaded by the loader
+       first. A packed screen (see `bintap_pack_screen()') is `screen_size'
+       bytes long with the depacker in front of it and is loaded at
+       `screen_address'. */
+    const char *screen;
+    unsigned int screen_size;
+    unsigned int screen_address;
+    char screen_layout;         /* BINTAP_SCREEN_* */
+};
+
+void bintap_init_config (struct bintap_config_t *cfg);
+const char *bintap_strerror (int err);
+unsigned int bintap_get_max_size (const struct bintap_config_t *cfg);
+
+int bintap_put_loader (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *basic_name, char *data_name, unsigned int blocks);
+int bintap_pack_screen (struct bintap_config_t *cfg, const char *screen,
+    struct lz_work_t *work);
+int bintap_put_steps_loader (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *basic_name, const struct bintap_step_t *steps, unsigned int count);
+int bintap_put_file (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, const char *data, unsigned int size);
+int bintap_put_packed_file (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, const char *data, unsigned int size, struct lz_work_t *work);
+int bintap_begin_file (TAPFILE *tape, const struct bintap_config_t *cfg,
+    char *name, unsigned int size);
+int bintap_end_file (TAPFILE *tape);
+int bintap_convert (const struct bintap_config_t *cfg, char *name,
+    const char *data, unsigned int size,
+    char *buf, unsigned int buf_size, unsigned int *tape_size);
+
+#endif  /* !_libbintap_h */
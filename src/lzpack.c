@@ -0,0 +1,190 @@
+/* lzpack.c - LZ packer with Z80 depacker.
+
+   `lzpack.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <stdint.h>
+#include <string.h>
+#include "lzpack.h"
+
+#define NO_POS 0xFFFF
+
+static unsigned int hash4 (const unsigned char *p)
+{
+    uint32_t x = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+
+    return (x * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static void insert (struct lz_work_t *work, const unsigned char *src, unsigned int pos)
+{
+    unsigned int h = hash4 (src + pos);
+
+    work->prev[pos] = work->head[h];
+    work->head[h] = pos;
+}
+
+/* Returns the length of the longest match for `pos' and its offset in `offset' */
+static unsigned int find_match (struct lz_work_t *work, const unsigned char *src,
+    unsigned int len, unsigned int pos, unsigned int *offset)
+{
+    unsigned int cand, max, best = 0, n, chain = LZ_MAX_CHAIN;
+
+    if (pos + LZ_MIN_MATCH > len)
+        return 0;
+    max = len - pos < LZ_MAX_MATCH ? len - pos : LZ_MAX_MATCH;
+    cand = work->head[hash4 (src + pos)];
+    while (cand != NO_POS && chain--)
+    {
+        if (src[cand + best] == src[pos + best])
+        {
+            for (n = 0; n < max && src[cand + n] == src[pos + n]; n++)
+                ;
+            if (n > best)
+            {
+                best = n;
+                *offset = pos - cand;
+                if (n == max)
+                    break;
+            }
+        }
+        cand = work->prev[cand];
+    }
+    return best >= LZ_MIN_MATCH ? best : 0;
+}
+
+/* Packs `len' bytes of `src' into `dest' (`LZ_MAX_PACKED_LEN(len)' bytes long).
+   Returns the length of packed stream. `gap' receives the minimal distance
+   between the starts of unpacked and packed data for in-place unpacking. */
+unsigned int lz_pack (struct lz_work_t *work, const char *src, unsigned int len,
+    char *dest, unsigned int *gap)
+{
+    const unsigned char *s = (const unsigned char *) src;
+    unsigned int pos = 0, lit = 0, out = 0, match, offset = 0, next_offset;
+    unsigned int n;
+    int max_gap = 0;
+
+    memset (work->head, 0xFF, sizeof (work->head));
+
+    /* `out - pos' is checked before every token (unpacked output must not
+       overtake packed input) */
+#define CHECK_GAP(in, done) \
+    if ((int) (done) - (int) (in) > max_gap) max_gap = (int) (done) - (int) (in)
+
+    while (pos < len)
+    {
+        match = find_match (work, s, len, pos, &offset);
+        if (pos + LZ_MIN_MATCH <= len)
+            insert (work, s, pos);
+        /* lazy matching: prefer a longer match at the next position */
+        if (match && match < LZ_MAX_MATCH
+        &&  find_match (work, s, len, pos + 1, &next_offset) > match + 1)
+            match = 0;
+
+        if (!match)
+        {
+            lit++;
+            pos++;
+            if (lit == LZ_MAX_LITERALS || pos == len)
+            {
+                CHECK_GAP (out, pos - lit);
+                dest[out++] = lit;
+                memcpy (dest + out, s + pos - lit, lit);
+                out += lit;
+                lit = 0;
+            }
+            continue;
+        }
+
+        if (lit)
+        {
+            CHECK_GAP (out, pos - lit);
+            dest[out++] = lit;
+            memcpy (dest + out, s + pos - lit, lit);
+            out += lit;
+            lit = 0;
+        }
+        CHECK_GAP (out, pos);
+        dest[out++] = 0x80 | (match - LZ_MIN_MATCH);
+        dest[out++] = offset % 256;
+        dest[out++] = offset / 256;
+        for (n = 1; n < match; n++)
+            if (pos + n + LZ_MIN_MATCH <= len)
+                insert (work, s, pos + n);
+        pos += match;
+    }
+#undef CHECK_GAP
+
+    /* end mark */
+    if ((int) len - (int) out > max_gap)
+        max_gap = len - out;
+    dest[out++] = 0;
+
+    *gap = max_gap;
+    work->packed_len = out;
+    return out;
+}
+
+/* Z80 depacker (relocatable, `LZ_DEPACKER_LEN' bytes) */
+static const unsigned char depacker[LZ_DEPACKER_LEN] =
+{
+    0x21, 0x00, 0x00,   /*      ld hl,src       */
+    0x11, 0x00, 0x00,   /*      ld de,dst       */
+    0x7E,               /* loop: ld a,(hl)      */
+    0x23,               /*      inc hl          */
+    0xB7,               /*      or a            */
+    0x28, 0x21,         /*      jr z,done       */
+    0x06, 0x00,         /*      ld b,0          */
+    0xCB, 0x7F,         /*      bit 7,a         */
+    0x20, 0x05,         /*      jr nz,match     */
+    0x4F,               /*      ld c,a          */
+    0xED, 0xB0,         /*      ldir            */
+    0x18, 0xF0,         /*      jr loop         */
+    0xE6, 0x7F,         /* match: and 7Fh       */
+    0xC6, LZ_MIN_MATCH, /*      add a,4         */
+    0x4F,               /*      ld c,a          */
+    0x7E,               /*      ld a,(hl)       */
+    0x23,               /*      inc hl          */
+    0xE5,               /*      push hl         */
+    0x66,               /*      ld h,(hl)       */
+    0x6F,               /*      ld l,a          */
+    0x7B,               /*      ld a,e          */
+    0x95,               /*      sub l           */
+    0x6F,               /*      ld l,a          */
+    0x7A,               /*      ld a,d          */
+    0x9C,               /*      sbc a,h         */
+    0x67,               /*      ld h,a          */
+    0xED, 0xB0,         /*      ldir            */
+    0xE1,               /*      pop hl          */
+    0x23,               /*      inc hl          */
+    0x18, 0xDA,         /*      jr loop         */
+    0xC3, 0x00, 0x00    /* done: jp exec        */
+};
+
+#define DEPACKER_SRC    1
+#define DEPACKER_DST    4
+#define DEPACKER_EXIT   44
+
+/* Makes depacker of stream at `src' to `dst' in `dest'. After unpacking it
+   jumps to `exec' or returns if `exec' is `LZ_EXIT_RET'. Returns its length. */
+unsigned int lz_make_depacker (char *dest, unsigned int src, unsigned int dst, int exec)
+{
+    memcpy (dest, depacker, LZ_DEPACKER_LEN);
+    dest[DEPACKER_SRC] = src % 256;
+    dest[DEPACKER_SRC + 1] = src / 256;
+    dest[DEPACKER_DST] = dst % 256;
+    dest[DEPACKER_DST + 1] = dst / 256;
+    if (exec == LZ_EXIT_RET)
+    {
+        dest[DEPACKER_EXIT] = 0xC9;     /* ret */
+        return DEPACKER_EXIT + 1;
+    }
+    dest[DEPACKER_EXIT + 1] = exec % 256;
+    dest[DEPACKER_EXIT + 2] = exec / 256;
+    return LZ_DEPACKER_LEN;
+}
@@ -0,0 +1,52 @@
+/* lzpack.h - declarations for `lzpack.c'.
+
+   `lzpack.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _lzpack_h
+#define _lzpack_h 1
+
+/* Packed stream is a sequence of tokens:
+
+   Token     Description
+   00        end of stream
+   01-7F     literal run: `token' bytes follow
+   80-FF     match: copy `(token & 7F) + 4' bytes from `offset' bytes back in
+             the output, 2 bytes of `offset' (little endian) follow
+
+   The stream is unpacked forward by a small Z80 routine placed right after the
+   stream. The stream is loaded above the destination so that unpacking never
+   overwrites bytes not read yet. */
+
+#define LZ_MAX_LEN          49152   /* maximal unpacked data length */
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_MATCH        (0x7F + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS     0x7F
+#define LZ_HASH_BITS        16
+#define LZ_MAX_CHAIN        64      /* match candidates checked per position */
+
+/* Maximal length of a packed stream for `n' bytes of data */
+#define LZ_MAX_PACKED_LEN(n) ((n) + (n) / LZ_MAX_LITERALS + 2)
+
+#define LZ_DEPACKER_LEN     47
+#define LZ_EXIT_RET         (-1)    /* return from depacker instead of jump */
+
+/* Work memory for packer (may be reused, not shared between threads) */
+struct lz_work_t
+{
+    unsigned short head[1 << LZ_HASH_BITS];
+    unsigned short prev[LZ_MAX_LEN];
+    char out[LZ_MAX_PACKED_LEN (LZ_MAX_LEN) + LZ_DEPACKER_LEN];
+    unsigned int packed_len;    /* length of the last packed stream */
+};
+
+unsigned int lz_pack (struct lz_work_t *work, const char *src, unsigned int len,
+    char *dest, unsigned int *gap);
+unsigned int lz_make_depacker (char *dest, unsigned int src, unsigned int dst, int exec);
+
+#endif  /* !_lzpack_h */
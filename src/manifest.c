@@ -0,0 +1,280 @@
+/* manifest.c - parser of tape manifest.
+
+   `manifest.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tapfile.h"
+#include "libbintap.h"
+#include "bastok.h"
+#include "manifest.h"
+
+#define NO_LOADER   ((unsigned int) -1)
+
+const char *manifest_strerror (int err)
+{
+    switch (err)
+    {
+    case MANIFEST_OK:
+        return "Success";
+    case MANIFEST_ERR_KEYWORD:
+        return "Unknown keyword";
+    case MANIFEST_ERR_VALUE:
+        return "Missing or invalid value";
+    case MANIFEST_ERR_PLACE:
+        return "Keyword does not belong here";
+    case MANIFEST_ERR_TOO_MANY:
+        return "Too many steps of loader";
+    case MANIFEST_ERR_MEMORY:
+        return "Not enough memory";
+    case MANIFEST_ERR_EMPTY:
+        return "No blocks";
+    default:
+        return "Unknown error";
+    }
+}
+
+void manifest_init (MANIFEST *self)
+{
+    self->items = NULL;
+    self->count = 0;
+    self->size = 0;
+    bintap_init_config (&self->loader);
+    self->loader.basic = 1;
+}
+
+static struct manifest_item_t *add_item (MANIFEST *self, char type)
+{
+    struct manifest_item_t *p;
+
+    if (self->count == self->size)
+    {
+        p = realloc (self->items,
+            sizeof (struct manifest_item_t) * (self->size ? self->size * 2 : 16));
+        if (!p)
+            return NULL;
+        self->items = p;
+        self->size = self->size ? self->size * 2 : 16;
+    }
+    p = &self->items[self->count++];
+    memset (p, 0, sizeof (struct manifest_item_t));
+    p->type = type;
+    p->load_address = BINTAP_DEF_LOAD_ADDR;
+    p->extra_address = BINTAP_DEF_EXTRA_ADDR;
+    p->start_line = BINTAP_DEF_START_LINE;
+    p->call = MANIFEST_NO_CALL;
+    p->load = type == MANIFEST_BYTES || type == MANIFEST_SCREEN;
+    if (type == MANIFEST_SCREEN)
+        p->load_address = BINTAP_SCREEN_ADDR;
+    return p;
+}
+
+/* Reads decimal or hexadecimal number `s' in range [0; `max'] into `value' */
+static char get_number (const char *s, unsigned int max, unsigned int *value)
+{
+    char *end;
+    long x;
+
+    errno = 0;
+    x = strtol (s, &end, 0);
+    if (errno || end == s || *end || x < 0 || x > max)
+        return 1;
+    *value = x;
+    return 0;
+}
+
+/* Reads title `s' (may be put in double quotes with escape sequences, see
+   `bastok.h') into `title' */
+static char get_title (char *s, char *title)
+{
+    unsigned int len;
+
+    len = strlen (s);
+    if (len >= 2 && s[0] == '"' && s[len - 1] == '"')
+    {
+        if (bastok_read_string (title, TAP_HEADER_NAME_LEN, s + 1, len - 2, &len))
+            return 1;
+        title[len] = '\0';
+        return 0;
+    }
+    if (len > TAP_HEADER_NAME_LEN)
+        return 1;
+    memcpy (title, s, len);
+    title[len] = '\0';
+    return 0;
+}
+
+/* Parses `key' with `value' (empty if none). `steps' counts steps of loader
+   (`NO_LOADER' before it). */
+static int parse_keyword (MANIFEST *self, const char *key, char *value,
+    unsigned int *steps)
+{
+    struct manifest_item_t *item = self->count ? &self->items[self->count - 1] : NULL;
+    struct bintap_config_t *cfg = &self->loader;
+    unsigned int x;
+
+    if (!strcmp (key, "loader"))
+    {
+        if (*steps != NO_LOADER)
+            return MANIFEST_ERR_PLACE;
+        *steps = 0;
+        return add_item (self, MANIFEST_LOADER) ? MANIFEST_OK : MANIFEST_ERR_MEMORY;
+    }
+    if (!strcmp (key, "bytes") || !strcmp (key, "program") || !strcmp (key, "screen"))
+    {
+        if (!*value)
+            return MANIFEST_ERR_VALUE;
+        item = add_item (self, key[0] == 'b' ? MANIFEST_BYTES
+            : key[0] == 'p' ? MANIFEST_PROGRAM : MANIFEST_SCREEN);
+        if (!item)
+            return MANIFEST_ERR_MEMORY;
+        item->file = value;
+        if (item->load && *steps != NO_LOADER && ++*steps > BINTAP_MAX_STEPS)
+            return MANIFEST_ERR_TOO_MANY;
+        return MANIFEST_OK;
+    }
+
+    /* keywords of loader */
+    if (!strcmp (key, "border-color") || !strcmp (key, "paper-color")
+    ||  !strcmp (key, "ink-color"))
+    {
+        if (get_number (value, BINTAP_MAX_COL, &x))
+            return MANIFEST_ERR_VALUE;
+        if (key[0] == 'b')
+            cfg->border_color = x;
+        else if (key[0] == 'p')
+            cfg->paper_color = x;
+        else
+            cfg->ink_color = x;
+        return MANIFEST_OK;
+    }
+    if (!strcmp (key, "clear-address"))
+    {
+        if (get_number (value, BINTAP_MAX_ADDR, &cfg->clear_address))
+            return MANIFEST_ERR_VALUE;
+        return MANIFEST_OK;
+    }
+    if (!strcmp (key, "no-print-headers"))
+    {
+        cfg->print_headers = 0;
+        return MANIFEST_OK;
+    }
+    if (!strcmp (key, "fast-numbers"))
+    {
+        cfg->fast_numbers = 1;
+        return MANIFEST_OK;
+    }
+    if (!strcmp (key, "d80"))
+    {
+        cfg->d80_syntax = 1;
+        return MANIFEST_OK;
+    }
+
+    /* keywords of the last block */
+    if (!strcmp (key, "title"))
+    {
+        if (!item)
+            return MANIFEST_ERR_PLACE;
+        return get_title (value, item->title) ? MANIFEST_ERR_VALUE : MANIFEST_OK;
+    }
+    if (!strcmp (key, "start-line"))
+    {
+        if (!item || item->type != MANIFEST_PROGRAM)
+            return MANIFEST_ERR_PLACE;
+        return get_number (value, BINTAP_MAX_LINE, &item->start_line)
+            ? MANIFEST_ERR_VALUE : MANIFEST_OK;
+    }
+    if (!strcmp (key, "load-address") || !strcmp (key, "extra-address")
+    ||  !strcmp (key, "call") || !strcmp (key, "no-load"))
+    {
+        if (!item || (item->type != MANIFEST_BYTES
+        &&  (item->type != MANIFEST_SCREEN || strcmp (key, "no-load"))))
+            return MANIFEST_ERR_PLACE;
+        if (!strcmp (key, "no-load"))
+        {
+            if (item->load && *steps != NO_LOADER)
+                --*steps;
+            item->load = 0;
+            return MANIFEST_OK;
+        }
+        if (get_number (value, BINTAP_MAX_ADDR, &x))
+            return MANIFEST_ERR_VALUE;
+        if (key[0] == 'l')
+            item->load_address = x;
+        else if (key[0] == 'e')
+            item->extra_address = x;
+        else
+        {
+            if (item->call == MANIFEST_NO_CALL && *steps != NO_LOADER
+            &&  ++*steps > BINTAP_MAX_STEPS)
+                return MANIFEST_ERR_TOO_MANY;
+            item->call = x;
+        }
+        return MANIFEST_OK;
+    }
+    return MANIFEST_ERR_KEYWORD;
+}
+
+/* Parses manifest `text' of `len' bytes (`text[len]' must be writable).
+   Values of keywords are cut in `text', so names of files point into it. On
+   error returns its code and the number of line in `err_line'. */
+int manifest_parse (MANIFEST *self, char *text, unsigned long len,
+    unsigned long *err_line)
+{
+    char *p, *eol, *end = text + len, *key, *value, *q;
+    unsigned long line = 0;
+    unsigned int steps = NO_LOADER;
+    int err;
+
+    for (p = text; p < end; p = eol + 1)
+    {
+        line++;
+        eol = memchr (p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        /* trailing spaces (and `\r') are cut */
+        for (q = eol; q > p && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == '\r'); q--)
+            ;
+        *q = '\0';
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p || *p == '#')
+            continue;
+
+        key = p;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+        value = p;
+        if (*p)
+        {
+            *value++ = '\0';
+            while (*value == ' ' || *value == '\t')
+                value++;
+        }
+        err = parse_keyword (self, key, value, &steps);
+        if (err)
+        {
+            *err_line = line;
+            return err;
+        }
+    }
+    if (!self->count)
+    {
+        *err_line = line;
+        return MANIFEST_ERR_EMPTY;
+    }
+    return MANIFEST_OK;
+}
+
+void manifest_free (MANIFEST *self)
+{
+    free (self->items);
+    manifest_init (self);
+}
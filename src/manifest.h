@@ -0,0 +1,79 @@
+/* manifest.h - declarations for `manifest.c'.
+
+   `manifest.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _manifest_h
+#define _manifest_h 1
+
+#include "tapfile.h"
+#include "libbintap.h"
+
+/* Manifest is a text file describing a tape made of several blocks, one
+   keyword with its value per line (empty lines and lines starting with `#' are
+   skipped):
+     loader                 BASIC loader of the following `Bytes' blocks
+     bytes FILE             `Bytes' block of binary file
+     program FILE           `Program' block of BASIC text file
+     screen FILE            `Bytes' block of screen file loaded by `SCREEN$'
+   followed by keywords of the last block:
+     title TITLE            header name (may be put in double quotes)
+     load-address ADDRESS   of `Bytes' block
+     extra-address ADDRESS  of `Bytes' block
+     start-line LINE        of `Program' block
+     call ADDRESS           loader calls ADDRESS after loading `Bytes' block
+     no-load                loader does not load `Bytes' or screen block
+   and keywords of the loader (anywhere):
+     border-color COLOR, paper-color COLOR, ink-color COLOR,
+     clear-address ADDRESS, no-print-headers, fast-numbers, d80.
+   Names of files are relative to the manifest. */
+
+/* Item type */
+#define MANIFEST_LOADER     0
+#define MANIFEST_BYTES      1
+#define MANIFEST_PROGRAM    2
+#define MANIFEST_SCREEN     3
+
+#define MANIFEST_NO_CALL    ((unsigned int) -1)
+
+struct manifest_item_t
+{
+    char type;
+    char *file;                 /* points into manifest's text */
+    char title[TAP_HEADER_NAME_LEN + 1];    /* empty to make of `file' */
+    unsigned int load_address;
+    unsigned int extra_address;
+    unsigned int start_line;
+    unsigned int call;          /* or `MANIFEST_NO_CALL' */
+    char load;                  /* loaded by loader */
+};
+
+typedef struct
+{
+    struct manifest_item_t *items;
+    unsigned int count;
+    unsigned int size;
+    struct bintap_config_t loader;  /* settings of loader */
+} MANIFEST;
+
+/* Error codes */
+#define MANIFEST_OK             0
+#define MANIFEST_ERR_KEYWORD    1   /* unknown keyword */
+#define MANIFEST_ERR_VALUE      2   /* missing or invalid value */
+#define MANIFEST_ERR_PLACE      3   /* keyword does not belong to the block */
+#define MANIFEST_ERR_TOO_MANY   4   /* too many steps of loader */
+#define MANIFEST_ERR_MEMORY     5
+#define MANIFEST_ERR_EMPTY      6   /* no blocks */
+
+const char *manifest_strerror (int err);
+void manifest_init (MANIFEST *self);
+int manifest_parse (MANIFEST *self, char *text, unsigned long len,
+    unsigned long *err_line);
+void manifest_free (MANIFEST *self);
+
+#endif  /* !_manifest_h */
@@ -8,8 +8,14 @@
    This is free and unencumbered software released into the public domain.
    For more information, please refer to <http://unlicense.org> */
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "checksum.h"
 #include "tapfile.h"
+#include "tzxfile.h"
 
 void fill_tape_header_name (char *dest, char *src)
 {
@@ -27,37 +33,239 @@ void fill_tape_header_name (char *dest, char *src)
     }
 }
 
-void tap_start (TAPFILE *self, char *data)
+void tap_start (TAPFILE *self, char *data, unsigned int capacity)
 {
     self->data = data;
     self->size = 0;
     self->block_size = 0;
+    self->capacity = capacity;
+    self->growable = 0;
+    self->error = 0;
+    self->fd = -1;
+    self->offset = 0;
+    self->stream_left = 0;
+    self->streaming = 0;
+    self->checksum = 0;
+    self->format = TAP_FORMAT_TAP;
+    self->timing = NULL;
+    self->prefix_len = 2;
+}
+
+char tap_start_dynamic (TAPFILE *self, unsigned int capacity)
+{
+    if (capacity < TAP_MIN_CAPACITY)
+        capacity = TAP_MIN_CAPACITY;
+    tap_start (self, malloc (capacity), capacity);
+    if (!self->data)
+    {
+        self->capacity = 0;
+        self->error = TAP_ERR_NO_SPACE;
+        return 1;
+    }
+    self->growable = 1;
+    return 0;
+}
+
+/* Output file (if any) is kept */
+void tap_reset (TAPFILE *self)
+{
+    self->size = 0;
+    self->block_size = 0;
+    self->error = 0;
+    self->offset = 0;
+    self->stream_left = 0;
+    self->streaming = 0;
+}
+
+void tap_free (TAPFILE *self)
+{
+    if (self->growable && self->data)
+        free (self->data);
+    self->data = NULL;
+    self->capacity = 0;
+    self->growable = 0;
+    tap_reset (self);
+}
+
+void tap_set_output (TAPFILE *self, int fd)
+{
+    self->fd = fd;
+}
+
+/* Format and timing may be changed between blocks only */
+void tap_set_format (TAPFILE *self, char format)
+{
+    self->format = format;
+    tap_set_timing (self, self->timing);
+}
+
+/* Following blocks of `.tzx' tape are turbo speed blocks with `timing' or
+   standard speed blocks if it is NULL. Ignored by `.tap' tape. */
+void tap_set_timing (TAPFILE *self, const struct tzx_timing_t *timing)
+{
+    self->timing = timing;
+    if (self->format == TAP_FORMAT_TZX)
+        self->prefix_len = tzx_get_prefix_len (timing);
+    else
+        self->prefix_len = 2;
+}
+
+/* Puts the prefix of a block of `type' with `len' bytes (`type' and checksum
+   included) into `dest' */
+static void put_prefix (TAPFILE *self, char *dest, char type, unsigned int len)
+{
+    if (self->format == TAP_FORMAT_TZX)
+        tzx_put_prefix (dest, self->timing, type, len);
+    else
+    {
+        dest[0] = len % 256;
+        dest[1] = len / 256;
+    }
+}
+
+static char write_all (TAPFILE *self, const char *src, unsigned int len)
+{
+    ssize_t n;
+
+    while (len)
+    {
+        n = write (self->fd, src, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            self->error = TAP_ERR_WRITE;
+            return 1;
+        }
+        src += n;
+        len -= n;
+        self->offset += n;
+    }
+    return 0;
+}
+
+/* Writes `count' buffers described by `iov' (modified) to output file */
+static char writev_all (TAPFILE *self, struct iovec *iov, int count)
+{
+    ssize_t n;
+
+    while (count)
+    {
+        n = writev (self->fd, iov, count);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            self->error = TAP_ERR_WRITE;
+            return 1;
+        }
+        self->offset += n;
+        while (count && (size_t) n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count)
+        {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/* Writes finished blocks to output file. The current block is moved to the
+   beginning of the buffer. Does nothing without output file. */
+char tap_flush (TAPFILE *self)
+{
+    unsigned int pending;
+
+    if (self->error)
+        return 1;
+    if (self->fd < 0 || !self->size)
+        return 0;
+
+    if (write_all (self, self->data, self->size))
+        return 1;
+    pending = self->block_size ? self->prefix_len + self->block_size : 0;
+    if (pending)
+        memmove (self->data, self->data + self->size, pending);
+    self->size = 0;
+    return 0;
+}
+
+/* Ensures there is space for `len' more bytes in the current block
+   (block's prefix and checksum bytes included). */
+char tap_reserve (TAPFILE *self, unsigned int len)
+{
+    unsigned long need, capacity;
+    char *data;
+
+    if (self->error)
+        return 1;
+
+    need = (unsigned long) self->size + self->prefix_len + self->block_size + len + 1;
+    if (need <= self->capacity)
+        return 0;
+
+    if (self->growable)
+    {
+        capacity = self->capacity;
+        while (capacity < need)
+            capacity *= 2;
+        if (capacity <= (unsigned int) -1)
+        {
+            data = realloc (self->data, capacity);
+            if (data)
+            {
+                self->data = data;
+                self->capacity = capacity;
+                return 0;
+            }
+        }
+    }
+
+    self->error = TAP_ERR_NO_SPACE;
+    return 1;
+}
+
+char tap_get_error (TAPFILE *self)
+{
+    return self->error;
 }
 
 void tap_new_block (TAPFILE *self)
 {
-    if (self->block_size)
+    if (self->block_size || self->streaming)
         tap_end_block (self);
 }
 
+/* Call `tap_reserve()' before writing at the returned pointer. */
 char *tap_get_cur_ptr (TAPFILE *self)
 {
-    return self->data + self->size + 2 + self->block_size;
+    return self->data + self->size + self->prefix_len + self->block_size;
 }
 
 void tap_put_char (TAPFILE *self, char c)
 {
-    self->data[self->size + 2 + self->block_size++] = c;
+    if (tap_reserve (self, 1))
+        return;
+    self->data[self->size + self->prefix_len + self->block_size++] = c;
 }
 
 void tap_put_data (TAPFILE *self, char *src, unsigned int len)
 {
-    memcpy (self->data + self->size + 2 + self->block_size, src, len);
+    if (tap_reserve (self, len))
+        return;
+    memcpy (self->data + self->size + self->prefix_len + self->block_size, src, len);
     self->block_size += len;
 }
 
 void tap_skip_data (TAPFILE *self, unsigned int len)
 {
+    if (tap_reserve (self, len))
+        return;
     self->block_size += len;
 }
 
@@ -65,6 +273,8 @@ void tap_put_program_header (TAPFILE *self, char *name,
     unsigned int length, unsigned int start_line, unsigned int prog_len)
 {
     struct tap_block_header_t *h;
+    if (tap_reserve (self, sizeof (struct tap_block_header_t)))
+        return;
     h = (struct tap_block_header_t *) tap_get_cur_ptr (self);
     h->type = TAP_HDR_PROGRAM;
     fill_tape_header_name (h->name, name);
@@ -78,6 +288,8 @@ void tap_put_bytes_header (TAPFILE *self, char *name,
     unsigned int length, unsigned int load_addr, unsigned int extra_addr)
 {
     struct tap_block_header_t *h;
+    if (tap_reserve (self, sizeof (struct tap_block_header_t)))
+        return;
     h = (struct tap_block_header_t *) tap_get_cur_ptr (self);
     h->type = TAP_HDR_BYTES;
     fill_tape_header_name (h->name, name);
@@ -87,28 +299,127 @@ void tap_put_bytes_header (TAPFILE *self, char *name,
     tap_skip_data (self, sizeof (struct tap_block_header_t));
 }
 
+/* Puts a whole block of `type' with `len' bytes of data from `src'. When
+   streaming the data is not copied: pending blocks, the new block's prefix,
+   type, data and checksum are written at once. */
+void tap_put_block (TAPFILE *self, char type, const char *src, unsigned int len)
+{
+    struct iovec iov[3];
+    char checksum;
+
+    if (self->fd < 0)
+    {
+        tap_begin_block (self, type, len);
+        tap_stream_data (self, src, len);
+        tap_end_block (self);
+        return;
+    }
+
+    tap_new_block (self);
+    if (tap_reserve (self, 1))
+        return;
+    put_prefix (self, self->data + self->size, type, len + 2);
+    self->size += self->prefix_len;
+    self->data[self->size++] = type;
+    checksum = xor_checksum (type, src, len);
+
+    iov[0].iov_base = self->data;
+    iov[0].iov_len = self->size;
+    iov[1].iov_base = (char *) src;
+    iov[1].iov_len = len;
+    iov[2].iov_base = &checksum;
+    iov[2].iov_len = 1;
+    self->size = 0;
+    writev_all (self, iov, 3);
+}
+
+/* Starts a new block of `type' with `len' bytes of data to be passed by
+   `tap_stream_data()'. */
+void tap_begin_block (TAPFILE *self, char type, unsigned int len)
+{
+    tap_new_block (self);
+    if (tap_reserve (self, 1))
+        return;
+    put_prefix (self, self->data + self->size, type, len + 2);
+    self->size += self->prefix_len;
+    self->data[self->size++] = type;
+    self->checksum = type;
+    self->stream_left = len;
+    self->streaming = 1;
+}
+
+void tap_stream_data (TAPFILE *self, const char *src, unsigned int len)
+{
+    if (self->error)
+        return;
+    if (!self->streaming || len > self->stream_left)
+    {
+        self->error = TAP_ERR_LENGTH;
+        return;
+    }
+
+    self->checksum = xor_checksum (self->checksum, src, len);
+    self->stream_left -= len;
+
+    if (self->fd >= 0)
+    {
+        /* pass data directly to output file */
+        if (tap_flush (self))
+            return;
+        write_all (self, src, len);
+    }
+    else
+    {
+        /* `block_size' is not used by a block of known length */
+        if (tap_reserve (self, len))
+            return;
+        memcpy (self->data + self->size, src, len);
+        self->size += len;
+    }
+}
+
+/* Finishes a block of known length */
+static void end_stream_block (TAPFILE *self)
+{
+    self->streaming = 0;
+    if (self->stream_left)
+    {
+        self->error = TAP_ERR_LENGTH;
+        return;
+    }
+    self->data[self->size++] = self->checksum;
+}
+
 void tap_end_block (TAPFILE *self)
 {
-    char *data = self->data + self->size + 2;
-    unsigned int checksum = 0;
-    unsigned int len = self->block_size;
+    char *data, checksum;
 
-    while (len--)
-        checksum ^= *(data++);
-    tap_put_char (self, checksum);
-    self->data[self->size++] = self->block_size % 256;
-    self->data[self->size++] = self->block_size / 256;
-    self->size += self->block_size;
-    self->block_size = 0;
+    if (tap_reserve (self, 0))
+        return;
+    if (self->streaming)
+        end_stream_block (self);
+    else
+    {
+        data = self->data + self->size + self->prefix_len;
+        checksum = xor_checksum (0, data, self->block_size);
+        data[self->block_size++] = checksum;
+        put_prefix (self, self->data + self->size, data[0], self->block_size);
+        self->size += self->prefix_len + self->block_size;
+        self->block_size = 0;
+    }
+    if (self->size >= TAP_FLUSH_SIZE)
+        tap_flush (self);
 }
 
 void tap_end (TAPFILE *self)
 {
-    if (self->block_size)
+    if (self->block_size || self->streaming)
         tap_end_block (self);
+    tap_flush (self);
 }
 
-unsigned int tap_get_size (TAPFILE *self)
+/* Returns the size of the whole tape (written to output file included) */
+unsigned long tap_get_size (TAPFILE *self)
 {
-    return self->size;
+    return self->offset + self->size;
 }
@@ -58,14 +58,67 @@ struct tap_block_header_t
 
 void fill_tape_header_name (char *dest, char *src);
 
+/* Tape format */
+#define TAP_FORMAT_TAP  0
+#define TAP_FORMAT_TZX  1   /* blocks only, see `tzxfile.h' */
+
+struct tzx_timing_t;
+
+/* Tape is built in `data' buffer of `capacity' bytes. A buffer given by caller
+   has fixed size, a buffer allocated by `tap_start_dynamic()' grows
+   geometrically when needed and is kept by `tap_reset()' for reuse.
+   Writing past the end of a fixed buffer (or failure to grow) sets `error' and
+   all further writes are ignored.
+
+   When output file `fd' is set by `tap_set_output()' the tape is streamed:
+   finished blocks are written out and only the current block is kept in
+   `data', so the buffer never holds more than one block (plus up to
+   `TAP_FLUSH_SIZE' bytes of small blocks waiting to be written together).
+   Data of a block started by `tap_begin_block()' with known length is passed
+   by `tap_stream_data()' directly to the output file and never copied into
+   `data'; its checksum is accumulated as the data flows. A whole block is
+   written by `tap_put_block()' together with pending blocks in one `writev()'
+   call.
+
+   Blocks of `.tzx' tape (set by `tap_set_format()') differ only in prefix
+   written in place of block's length, so the data is the same in both formats.
+   The file header of `.tzx' tape is not written here. */
 typedef struct
 {
     char *data;
     unsigned int size;
     unsigned int block_size;
+    unsigned int capacity;
+    char growable;
+    char error;
+    int fd;                 /* output file or -1 */
+    unsigned long offset;   /* bytes written to `fd' */
+    unsigned int stream_left;   /* bytes left in a block of known length */
+    char streaming;         /* current block has known length */
+    char checksum;          /* of a block of known length */
+    char format;            /* TAP_FORMAT_* */
+    const struct tzx_timing_t *timing;  /* of turbo speed blocks or NULL */
+    unsigned int prefix_len;    /* of a block in `format' */
 } TAPFILE;
 
-void tap_start (TAPFILE *self, char *data);
+#define TAP_MIN_CAPACITY 256
+#define TAP_FLUSH_SIZE   16384
+
+/* Error codes */
+#define TAP_ERR_NO_SPACE    1   /* buffer overflow */
+#define TAP_ERR_WRITE       2   /* failed to write output file */
+#define TAP_ERR_LENGTH      3   /* block's data does not match its length */
+
+void tap_start (TAPFILE *self, char *data, unsigned int capacity);
+char tap_start_dynamic (TAPFILE *self, unsigned int capacity);
+void tap_reset (TAPFILE *self);
+void tap_free (TAPFILE *self);
+void tap_set_output (TAPFILE *self, int fd);
+void tap_set_format (TAPFILE *self, char format);
+void tap_set_timing (TAPFILE *self, const struct tzx_timing_t *timing);
+char tap_flush (TAPFILE *self);
+char tap_reserve (TAPFILE *self, unsigned int len);
+char tap_get_error (TAPFILE *self);
 void tap_new_block (TAPFILE *self);
 char *tap_get_cur_ptr (TAPFILE *self);
 void tap_put_char (TAPFILE *self, char c);
@@ -75,8 +128,11 @@ void tap_put_program_header (TAPFILE *self, char *name, unsigned int length,
     unsigned int start_line, unsigned int vars_off);
 void tap_put_bytes_header (TAPFILE *self, char *name, unsigned int length,
     unsigned int load_addr, unsigned int extra_addr);
+void tap_put_block (TAPFILE *self, char type, const char *src, unsigned int len);
+void tap_begin_block (TAPFILE *self, char type, unsigned int len);
+void tap_stream_data (TAPFILE *self, const char *src, unsigned int len);
 void tap_end_block (TAPFILE *self);
 void tap_end (TAPFILE *self);
-unsigned int tap_get_size (TAPFILE *self);
+unsigned long tap_get_size (TAPFILE *self);
 
 #endif  /* !_tapfile_h */
@@ -0,0 +1,315 @@
+/* tapindex.c - `.tap' tape file reader.
+
+   `tapindex.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "checksum.h"
+#include "tapfile.h"
+#include "tapindex.h"
+
+void tap_index_init (TAPINDEX *self)
+{
+    self->fd = -1;
+    self->file_size = 0;
+    self->end = 0;
+    self->truncated = 0;
+    self->blocks = NULL;
+    self->count = 0;
+    self->size = 0;
+}
+
+/* Reads exactly `len' bytes at `offset' */
+static char read_at (int fd, char *buf, unsigned int len, unsigned long offset)
+{
+    ssize_t n;
+
+    while (len)
+    {
+        n = pread (fd, buf, len, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 1;
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static struct tap_index_entry_t *add_entry (TAPINDEX *self)
+{
+    struct tap_index_entry_t *p;
+
+    if (self->count == self->size)
+    {
+        p = realloc (self->blocks,
+            sizeof (struct tap_index_entry_t) * (self->size ? self->size * 2 : 64));
+        if (!p)
+            return NULL;
+        self->blocks = p;
+        self->size = self->size ? self->size * 2 : 64;
+    }
+    p = &self->blocks[self->count++];
+    memset (p, 0, sizeof (struct tap_index_entry_t));
+    return p;
+}
+
+/* Builds index of tape file `fd'. Only length fields and headers are read
+   unless `check' is set, in which case every block is read to verify its
+   checksum. Returns `TAP_INDEX_ERR_*' code or 0. */
+char tap_index_build (TAPINDEX *self, int fd, char check)
+{
+    struct stat st;
+    struct tap_index_entry_t *e;
+    unsigned long offset = 0;
+    unsigned char prefix[2 + 1 + sizeof (struct tap_block_header_t)];
+    unsigned int len, n;
+    char *buf = NULL;
+    char err = 0;
+
+    tap_index_free (self);
+    self->fd = fd;
+    if (fstat (fd, &st))
+        return TAP_INDEX_ERR_READ;
+    self->file_size = st.st_size;
+
+    if (check)
+    {
+        buf = malloc (TAP_MAX_BLOCK_SIZE);
+        if (!buf)
+            return TAP_INDEX_ERR_MEMORY;
+    }
+
+    while (!err && offset < self->file_size)
+    {
+        if (offset + 2 > self->file_size)
+        {
+            self->truncated = 1;
+            break;
+        }
+        /* length field, type and standard header when they fit into the file */
+        n = sizeof (prefix);
+        if (offset + n > self->file_size)
+            n = self->file_size - offset;
+        if (read_at (fd, (char *) prefix, n, offset))
+        {
+            err = TAP_INDEX_ERR_READ;
+            break;
+        }
+        len = prefix[0] + prefix[1] * 256;
+        if (offset + 2 + len > self->file_size)
+        {
+            self->truncated = 1;
+            break;
+        }
+
+        e = add_entry (self);
+        if (!e)
+        {
+            err = TAP_INDEX_ERR_MEMORY;
+            break;
+        }
+        e->offset = offset;
+        e->length = len;
+        if (len)
+            e->type = prefix[2];
+        if (len == sizeof (struct tap_block_header_t) + 2 && e->type == TAP_BLK_HEADER)
+        {
+            e->is_header = 1;
+            memcpy (&e->header, prefix + 3, sizeof (struct tap_block_header_t));
+        }
+        if (check)
+            err = tap_index_check_block (self, self->count - 1, buf);
+
+        offset += 2 + len;
+        self->end = offset;
+    }
+
+    free (buf);
+    return err;
+}
+
+/* Reads block `n' (length field included) into `buf' of at least
+   `TAP_MAX_BLOCK_SIZE' bytes */
+char tap_index_read_block (TAPINDEX *self, unsigned int n, char *buf)
+{
+    if (n >= self->count)
+        return TAP_INDEX_ERR_RANGE;
+    if (read_at (self->fd, buf, self->blocks[n].length + 2, self->blocks[n].offset))
+        return TAP_INDEX_ERR_READ;
+    return 0;
+}
+
+/* Copies `len' bytes of the file at `offset' into file `fo' at its current
+   position. The bytes are copied inside the kernel when possible, otherwise
+   through `buf' of at least `TAP_MAX_BLOCK_SIZE' bytes. */
+char tap_index_copy_range (TAPINDEX *self, unsigned long offset, unsigned long len,
+    int fo, char *buf)
+{
+    off_t pos = offset;
+    ssize_t done = 0;
+    unsigned int n;
+    char *p;
+
+    if (offset + len > self->file_size)
+        return TAP_INDEX_ERR_RANGE;
+    while (len && (done = copy_file_range (self->fd, &pos, fo, NULL,
+        len < (1UL << 30) ? len : (1UL << 30), 0)) > 0)
+        len -= done;
+    if (!len)
+        return 0;
+    if (!done)
+        return TAP_INDEX_ERR_READ;
+    if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+        return TAP_INDEX_ERR_WRITE;
+
+    /* the rest of data */
+    for (; len; len -= n, pos += n)
+    {
+        n = len < TAP_MAX_BLOCK_SIZE ? len : TAP_MAX_BLOCK_SIZE;
+        if (read_at (self->fd, buf, n, pos))
+            return TAP_INDEX_ERR_READ;
+        for (p = buf; p < buf + n; p += done)
+        {
+            done = write (fo, p, buf + n - p);
+            if (done < 0)
+            {
+                if (errno != EINTR)
+                    return TAP_INDEX_ERR_WRITE;
+                done = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Copies `len' bytes of block `n' starting from byte `skip' (of the length
+   field) like `tap_index_copy_range()' */
+char tap_index_copy_block (TAPINDEX *self, unsigned int n, unsigned int skip,
+    unsigned int len, int fo, char *buf)
+{
+    if (n >= self->count || skip + len > self->blocks[n].length + 2)
+        return TAP_INDEX_ERR_RANGE;
+    return tap_index_copy_range (self, self->blocks[n].offset + skip, len, fo, buf);
+}
+
+/* Reads block `n' into `buf' and updates its checksum state */
+char tap_index_check_block (TAPINDEX *self, unsigned int n, char *buf)
+{
+    struct tap_index_entry_t *e;
+    char err;
+
+    err = tap_index_read_block (self, n, buf);
+    if (err)
+        return err;
+    e = &self->blocks[n];
+    if (e->length && !xor_checksum (0, buf + 2, e->length))
+        e->checksum = TAP_CHECKSUM_OK;
+    else
+        e->checksum = TAP_CHECKSUM_BAD;
+    return 0;
+}
+
+/* Reads block `n' into `buf' and writes its right checksum into the file
+   (opened for writing) */
+char tap_index_fix_checksum (TAPINDEX *self, unsigned int n, char *buf)
+{
+    struct tap_index_entry_t *e;
+    char err, c;
+
+    err = tap_index_read_block (self, n, buf);
+    if (err)
+        return err;
+    e = &self->blocks[n];
+    if (!e->length)
+        return TAP_INDEX_ERR_RANGE;
+    c = xor_checksum (0, buf + 2, e->length - 1);
+    if (pwrite (self->fd, &c, 1, e->offset + 2 + e->length - 1) != 1)
+        return TAP_INDEX_ERR_WRITE;
+    e->checksum = TAP_CHECKSUM_OK;
+    return 0;
+}
+
+/* Returns `TAP_PROBLEM_*' flags of block `n'. Checksum is known only for the
+   blocks which were read. */
+unsigned int tap_index_get_problems (const TAPINDEX *self, unsigned int n)
+{
+    const struct tap_index_entry_t *e = &self->blocks[n], *next;
+    unsigned int problems = 0;
+
+    if (e->length < 2)
+        return TAP_PROBLEM_SHORT;
+    if (e->checksum == TAP_CHECKSUM_BAD)
+        problems |= TAP_PROBLEM_CHECKSUM;
+    if (e->type == TAP_BLK_HEADER)
+    {
+        /* a header is loaded by ROM together with the next block */
+        next = n + 1 < self->count ? &self->blocks[n + 1] : NULL;
+        if (!e->is_header || (unsigned char) e->header.type > TAP_HDR_BYTES)
+            problems |= TAP_PROBLEM_HEADER;
+        else if (!next || next->type != (unsigned char) TAP_BLK_DATA)
+            problems |= TAP_PROBLEM_NO_DATA;
+        else if (next->length != (unsigned int) e->header.length + 2)
+            problems |= TAP_PROBLEM_DATA_LEN;
+    }
+    else if (e->type != (unsigned char) TAP_BLK_DATA)
+        problems |= TAP_PROBLEM_FLAG;
+    return problems;
+}
+
+void tap_index_free (TAPINDEX *self)
+{
+    if (self->blocks)
+        free (self->blocks);
+    tap_index_init (self);
+}
+
+const char *tap_problem_name (unsigned int problem)
+{
+    switch (problem)
+    {
+    case TAP_PROBLEM_SHORT:
+        return "block is too short";
+    case TAP_PROBLEM_FLAG:
+        return "unknown flag";
+    case TAP_PROBLEM_HEADER:
+        return "invalid header";
+    case TAP_PROBLEM_NO_DATA:
+        return "header without data block";
+    case TAP_PROBLEM_DATA_LEN:
+        return "data length differs from header";
+    case TAP_PROBLEM_CHECKSUM:
+        return "bad checksum";
+    default:
+        return "unknown problem";
+    }
+}
+
+const char *tap_header_type_name (char type)
+{
+    switch (type)
+    {
+    case TAP_HDR_PROGRAM:
+        return "Program";
+    case TAP_HDR_NUMBER_ARRAY:
+        return "Number array";
+    case TAP_HDR_CHARACTER_ARRAY:
+        return "Character array";
+    case TAP_HDR_BYTES:
+        return "Bytes";
+    default:
+        return "Unknown";
+    }
+}
@@ -0,0 +1,75 @@
+/* tapindex.h - declarations for `tapindex.c'.
+
+   `tapindex.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _tapindex_h
+#define _tapindex_h 1
+
+#include "tapfile.h"
+
+/* Maximal size of a block (length field included) */
+#define TAP_MAX_BLOCK_SIZE (2 + 65535)
+
+/* Checksum state */
+#define TAP_CHECKSUM_UNKNOWN    0   /* block's data was not read */
+#define TAP_CHECKSUM_OK         1
+#define TAP_CHECKSUM_BAD        2
+
+struct tap_index_entry_t
+{
+    unsigned long offset;       /* offset of block's length field in file */
+    unsigned int length;        /* value of length field (type and checksum included) */
+    unsigned char type;         /* `TAP_BLK_HEADER', `TAP_BLK_DATA' or other flag */
+    char checksum;              /* `TAP_CHECKSUM_*' */
+    char is_header;             /* standard header, `header' is valid */
+    struct tap_block_header_t header;
+};
+
+/* Index of blocks of a tape file. Built by one pass over the file. */
+typedef struct
+{
+    int fd;
+    unsigned long file_size;
+    unsigned long end;          /* offset after the last complete block */
+    char truncated;             /* file ends inside a block */
+    struct tap_index_entry_t *blocks;
+    unsigned int count;
+    unsigned int size;
+} TAPINDEX;
+
+/* Problems of a block found by `tap_index_get_problems()' (flags) */
+#define TAP_PROBLEM_SHORT       0x01    /* no room for flag and checksum */
+#define TAP_PROBLEM_FLAG        0x02    /* flag is neither header nor data */
+#define TAP_PROBLEM_HEADER      0x04    /* header of wrong length or type */
+#define TAP_PROBLEM_NO_DATA     0x08    /* header is not followed by data */
+#define TAP_PROBLEM_DATA_LEN    0x10    /* data length differs from header */
+#define TAP_PROBLEM_CHECKSUM    0x20    /* bad checksum */
+
+/* Error codes */
+#define TAP_INDEX_ERR_READ      1
+#define TAP_INDEX_ERR_MEMORY    2
+#define TAP_INDEX_ERR_RANGE     3
+#define TAP_INDEX_ERR_WRITE     4
+
+void tap_index_init (TAPINDEX *self);
+char tap_index_build (TAPINDEX *self, int fd, char check);
+char tap_index_read_block (TAPINDEX *self, unsigned int n, char *buf);
+char tap_index_copy_range (TAPINDEX *self, unsigned long offset, unsigned long len,
+    int fo, char *buf);
+char tap_index_copy_block (TAPINDEX *self, unsigned int n, unsigned int skip,
+    unsigned int len, int fo, char *buf);
+char tap_index_check_block (TAPINDEX *self, unsigned int n, char *buf);
+char tap_index_fix_checksum (TAPINDEX *self, unsigned int n, char *buf);
+unsigned int tap_index_get_problems (const TAPINDEX *self, unsigned int n);
+void tap_index_free (TAPINDEX *self);
+
+const char *tap_header_type_name (char type);
+const char *tap_problem_name (unsigned int problem);
+
+#endif  /* !_tapindex_h */
@@ -0,0 +1,319 @@
+/* turbo.c - Z80 turbo loader generator.
+
+   `turbo.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <string.h>
+#include "tzxfile.h"
+#include "turbo.h"
+
+/* Loading routine: IX = address, DE = length. Returns CF=1 on success.
+   It is ROM's LD-BYTES with a shorter wait for pilot tone and its own edge
+   routine for data bits. `*' marks bytes patched by `turbo_make_loader()'. */
+static const unsigned char load_bytes[] =
+{
+    0xDB, 0xFE,         /*      in a,(0FEh)     */
+    0x1F,               /*      rra             */
+    0xE6, 0x20,         /*      and 20h         */
+    0xF6, 0x02,         /*      or 02h          */
+    0x4F,               /*      ld c,a          */
+    0xBF,               /*      cp a            */
+    0xC0,               /* break: ret nz        */
+    0xCD, 0xE7, 0x05,   /* start: call 05E7h    ; LD-EDGE-1 */
+    0x30, 0xFA,         /*      jr nc,break     */
+    0x21, 0x40, 0x00,   /*      ld hl,0040h     ; ~60 ms */
+    0x10, 0xFE,         /* wait: djnz wait      */
+    0x2B,               /*      dec hl          */
+    0x7C,               /*      ld a,h          */
+    0xB5,               /*      or l            */
+    0x20, 0xF9,         /*      jr nz,wait      */
+    0xCD, 0xE3, 0x05,   /*      call 05E3h      ; LD-EDGE-2 */
+    0x30, 0xEB,         /*      jr nc,break     */
+    0x06, 0x9C,         /* leader: ld b,9Ch     */
+    0xCD, 0xE3, 0x05,   /*      call 05E3h      */
+    0x30, 0xE4,         /*      jr nc,break     */
+    0x3E, 0xC6,         /*      ld a,0C6h       */
+    0xB8,               /*      cp b            */
+    0x30, 0xE0,         /*      jr nc,start     */
+    0x24,               /*      inc h           */
+    0x20, 0xF1,         /*      jr nz,leader    */
+    0x06, 0xC9,         /* sync: ld b,0C9h      */
+    0xCD, 0xE7, 0x05,   /*      call 05E7h      */
+    0x30, 0xD5,         /*      jr nc,break     */
+    0x78,               /*      ld a,b          */
+    0xFE, 0xD4,         /*      cp 0D4h         */
+    0x30, 0xF4,         /*      jr nc,sync      */
+    0xCD, 0xE7, 0x05,   /*      call 05E7h      */
+    0xD0,               /*      ret nc          */
+    0x79,               /*      ld a,c          */
+    0xEE, 0x03,         /*      xor 03h         */
+    0x4F,               /*      ld c,a          */
+    0x26, 0x00,         /*      ld h,0          ; checksum */
+    0x06, 0x00,         /*      ld b,*          ; flag byte */
+    0xCD, 0x67, 0x00,   /*      call byte*      */
+    0xD0,               /*      ret nc          */
+    0x7D,               /*      ld a,l          */
+    0xC6, 0x01,         /*      add a,1         ; CF=1 if flag is 0FFh */
+    0xD0,               /*      ret nc          */
+    0x06, 0x00,         /* loop: ld b,*         */
+    0xCD, 0x67, 0x00,   /*      call byte*      */
+    0xD0,               /*      ret nc          */
+    0xDD, 0x75, 0x00,   /*      ld (ix+0),l     */
+    0xDD, 0x23,         /*      inc ix          */
+    0x1B,               /*      dec de          */
+    0x7A,               /*      ld a,d          */
+    0xB3,               /*      or e            */
+    0x20, 0xF0,         /*      jr nz,loop      */
+    0x06, 0x00,         /*      ld b,*          ; checksum byte */
+    0xCD, 0x67, 0x00,   /*      call byte*      */
+    0xD0,               /*      ret nc          */
+    0x7C,               /*      ld a,h          */
+    0xFE, 0x01,         /*      cp 1            */
+    0xC9,               /*      ret             */
+    0x2E, 0x01,         /* byte: ld l,1         */
+    0xCD, 0x7C, 0x00,   /* bits: call edge2*    */
+    0xD0,               /*      ret nc          */
+    0x3E, 0x00,         /*      ld a,*          ; threshold */
+    0xB8,               /*      cp b            */
+    0xCB, 0x15,         /*      rl l            */
+    0x06, 0x00,         /*      ld b,*          ; next bit */
+    0xD2, 0x69, 0x00,   /*      jp nc,bits*     */
+    0x7C,               /*      ld a,h          */
+    0xAD,               /*      xor l           */
+    0x67,               /*      ld h,a          */
+    0x37,               /*      scf             */
+    0xC9,               /*      ret             */
+    0xCD, 0x80, 0x00,   /* edge2: call edge1*   */
+    0xD0,               /*      ret nc          */
+    0x3E, 0x00,         /* edge1: ld a,*        ; delay */
+    0x3D,               /* delay: dec a         */
+    0x20, 0xFD,         /*      jr nz,delay     */
+    0xA7,               /*      and a           */
+    0x04,               /* sample: inc b        */
+    0xC8,               /*      ret z           */
+    0x3E, 0x7F,         /*      ld a,7Fh        */
+    0xDB, 0xFE,         /*      in a,(0FEh)     */
+    0x1F,               /*      rra             */
+    0xD0,               /*      ret nc          */
+    0xA9,               /*      xor c           */
+    0xE6, 0x20,         /*      and 20h         */
+    0x28, 0xF3,         /*      jr z,sample     */
+    0x79,               /*      ld a,c          */
+    0x2F,               /*      cpl             */
+    0x4F,               /*      ld c,a          */
+    0xE6, 0x07,         /*      and 07h         */
+    0xF6, 0x08,         /*      or 08h          */
+    0xD3, 0xFE,         /*      out (0FEh),a    */
+    0x37,               /*      scf             */
+    0xC9                /*      ret             */
+};
+
+/* Offsets of patched bytes in `load_bytes' */
+#define LB_FIRST        0x44
+#define LB_LOOP         0x4E
+#define LB_LAST         0x5E
+#define LB_THRESHOLD    0x6E
+#define LB_NEXT         0x73
+#define LB_DELAY        0x81
+static const unsigned char load_bytes_relocs[] = { 0x46, 0x50, 0x60, 0x6A, 0x75, 0x7D };
+
+/* T-states of one bit besides `delay' loops and samples: edge routine is
+   called twice and a sample takes 59 T-states */
+#define BIT_FIXED       184
+#define DELAY_LOOP      16
+#define SAMPLE          59
+
+/* Extra T-states spent before the first bit of the flag byte and of a data
+   byte */
+#define FIRST_EXTRA     34
+#define BYTE_EXTRA      117
+
+struct bit_timing_t
+{
+    unsigned int delay;
+    unsigned int first;     /* B before the first bit of flag byte */
+    unsigned int byte;      /* B before the first bit of a byte */
+    unsigned int next;      /* B before the next bit */
+    unsigned int threshold;
+};
+
+/* Returns 0 on success */
+static char get_bit_timing (const struct tzx_timing_t *timing, struct bit_timing_t *bit)
+{
+    unsigned int fixed, zero, one, timeout;
+
+    /* the delay filters noise for a third of shorter pulse */
+    bit->delay = timing->zero / 3 > 6 + DELAY_LOOP ? (timing->zero / 3 - 6) / DELAY_LOOP : 1;
+    if (bit->delay > 0x16)
+        bit->delay = 0x16;
+    fixed = BIT_FIXED + 2 * DELAY_LOOP * bit->delay;
+
+    /* samples taken for zero and one bits */
+    if (timing->zero * 2 < fixed + 3 * SAMPLE || timing->one <= timing->zero)
+        return 1;
+    zero = (timing->zero * 2 - fixed) / SAMPLE;
+    one = (timing->one * 2 - fixed) / SAMPLE;
+    if (one < zero + 6)
+        return 1;
+    timeout = one * 2 + 8;
+    if (timeout > 250)
+        return 1;
+
+    bit->next = 256 - timeout;
+    bit->threshold = bit->next + (timing->zero + timing->one - fixed + SAMPLE / 2) / SAMPLE;
+    bit->first = bit->next + (FIRST_EXTRA + SAMPLE / 2) / SAMPLE;
+    bit->byte = bit->next + (BYTE_EXTRA + SAMPLE / 2) / SAMPLE;
+    return 0;
+}
+
+/* Returns the address to run the loading routine at. Data bits are timed by
+   counting loops, so it is run in uncontended memory above 32767 out of the
+   way of `blocks', machine stack below `stack' and user-defined graphics.
+   Returns 0 when there is no place for it. */
+static unsigned int get_place (const struct turbo_block_t *blocks,
+    unsigned int count, unsigned int stack)
+{
+    unsigned int end = TURBO_UDG_ADDR, start, low, i;
+    char moved;
+
+    low = stack > TURBO_STACK_LEN ? stack - TURBO_STACK_LEN : 0;
+    do
+    {
+        moved = 0;
+        start = end - sizeof (load_bytes);
+        if (start <= stack && end > low)
+        {
+            end = low;
+            moved = 1;
+        }
+        for (i = 0; i < count; i++)
+            if (start < blocks[i].address + blocks[i].length
+            &&  end > blocks[i].address)
+            {
+                end = blocks[i].address;
+                moved = 1;
+            }
+    } while (moved && end >= TURBO_FAST_ADDR + sizeof (load_bytes));
+    return end >= TURBO_FAST_ADDR + sizeof (load_bytes) ? end - sizeof (load_bytes) : 0;
+}
+
+/* Returns 0 if there is a place for the loading routine out of the way of
+   `blocks' and machine stack below `stack' */
+char turbo_check_blocks (const struct turbo_block_t *blocks, unsigned int count,
+    unsigned int stack)
+{
+    return !get_place (blocks, count, stack);
+}
+
+/* Returns 0 if the turbo loader can load blocks with `timing' */
+char turbo_check_timing (const struct tzx_timing_t *timing)
+{
+    struct bit_timing_t bit;
+
+    if (timing->pilot != TZX_ROM_PILOT
+    ||  timing->sync1 != TZX_ROM_SYNC1
+    ||  timing->sync2 != TZX_ROM_SYNC2
+    ||  timing->pulses < TURBO_MIN_PULSES)
+        return 1;
+    return get_bit_timing (timing, &bit);
+}
+
+static unsigned int put_byte (char *dest, unsigned int pos, unsigned int x)
+{
+    dest[pos] = x;
+    return pos + 1;
+}
+
+static unsigned int put_word (char *dest, unsigned int pos, unsigned int x)
+{
+    dest[pos] = x % 256;
+    dest[pos + 1] = x / 256;
+    return pos + 2;
+}
+
+/* Makes the loader of `count' `blocks' at `TURBO_LOADER_ADDR' jumping to `exec'
+   in `dest' (`TURBO_MAX_LEN(count)' bytes long). `stack' is the top of machine
+   stack (CLEAR address). Returns its length or 0 if `timing' is not
+   supported or there is no place for the loading routine. */
+unsigned int turbo_make_loader (char *dest, const struct tzx_timing_t *timing,
+    const struct turbo_block_t *blocks, unsigned int count, unsigned int exec,
+    unsigned int stack)
+{
+    struct bit_timing_t bit;
+    unsigned int error, border, src, load, pos = 0, i, x;
+
+    load = get_place (blocks, count, stack);
+    if (turbo_check_timing (timing) || get_bit_timing (timing, &bit) || !load)
+        return 0;
+
+    /* addresses of routines following the block list */
+    error = TURBO_LOADER_ADDR + 12 + count * 13 + 7;
+    border = error + 6;
+    src = border + 11;
+
+    pos = put_byte (dest, pos, 0xF3);               /* di */
+    pos = put_byte (dest, pos, 0x21);               /* ld hl,src */
+    pos = put_word (dest, pos, src);
+    pos = put_byte (dest, pos, 0x11);               /* ld de,load */
+    pos = put_word (dest, pos, load);
+    pos = put_byte (dest, pos, 0x01);               /* ld bc,length */
+    pos = put_word (dest, pos, sizeof (load_bytes));
+    pos = put_byte (dest, pos, 0xED);               /* ldir */
+    pos = put_byte (dest, pos, 0xB0);
+    for (i = 0; i < count; i++)
+    {
+        pos = put_byte (dest, pos, 0xDD);           /* ld ix,address */
+        pos = put_byte (dest, pos, 0x21);
+        pos = put_word (dest, pos, blocks[i].address);
+        pos = put_byte (dest, pos, 0x11);           /* ld de,length */
+        pos = put_word (dest, pos, blocks[i].length);
+        pos = put_byte (dest, pos, 0xCD);           /* call load */
+        pos = put_word (dest, pos, load);
+        pos = put_byte (dest, pos, 0xD2);           /* jp nc,error */
+        pos = put_word (dest, pos, error);
+    }
+    pos = put_byte (dest, pos, 0xCD);               /* call border */
+    pos = put_word (dest, pos, border);
+    pos = put_byte (dest, pos, 0xFB);               /* ei */
+    pos = put_byte (dest, pos, 0xC3);               /* jp exec */
+    pos = put_word (dest, pos, exec);
+
+    /* error: */
+    pos = put_byte (dest, pos, 0xCD);               /* call border */
+    pos = put_word (dest, pos, border);
+    pos = put_byte (dest, pos, 0xFB);               /* ei */
+    pos = put_byte (dest, pos, 0xCF);               /* rst 8 */
+    pos = put_byte (dest, pos, 0x1A);               /* "R Tape loading error" */
+
+    /* border: restores border color from BORDCR */
+    pos = put_byte (dest, pos, 0x3A);               /* ld a,(5C48h) */
+    pos = put_word (dest, pos, 0x5C48);
+    pos = put_byte (dest, pos, 0xE6);               /* and 38h */
+    pos = put_byte (dest, pos, 0x38);
+    pos = put_byte (dest, pos, 0x0F);               /* rrca */
+    pos = put_byte (dest, pos, 0x0F);               /* rrca */
+    pos = put_byte (dest, pos, 0x0F);               /* rrca */
+    pos = put_byte (dest, pos, 0xD3);               /* out (0FEh),a */
+    pos = put_byte (dest, pos, 0xFE);
+    pos = put_byte (dest, pos, 0xC9);               /* ret */
+
+    /* load: (copied to `load' address) */
+    memcpy (dest + pos, load_bytes, sizeof (load_bytes));
+    for (i = 0; i < sizeof (load_bytes_relocs); i++)
+    {
+        x = load + load_bytes[load_bytes_relocs[i]];
+        put_word (dest, pos + load_bytes_relocs[i], x);
+    }
+    dest[pos + LB_FIRST] = bit.first;
+    dest[pos + LB_LOOP] = bit.byte;
+    dest[pos + LB_LAST] = bit.byte;
+    dest[pos + LB_THRESHOLD] = bit.threshold;
+    dest[pos + LB_NEXT] = bit.next;
+    dest[pos + LB_DELAY] = bit.delay;
+    return pos + sizeof (load_bytes);
+}
@@ -0,0 +1,47 @@
+/* turbo.h - declarations for `turbo.c'.
+
+   `turbo.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _turbo_h
+#define _turbo_h 1
+
+#include "tzxfile.h"
+
+/* Z80 turbo loader loads data blocks (with no headers) saved as turbo speed
+   blocks. Pilot tone and sync pulses are detected by ROM routines, so they
+   must have ROM timings; data bits are read by its own edge routine tuned for
+   `zero' and `one' pulses. After loading all blocks it jumps to the given
+   address, on error it reports "R Tape loading error".
+
+   The loader is placed into REM statement of the first line of BASIC program
+   and called at `TURBO_LOADER_ADDR' (PROG + 5 when PROG = 23755). It copies
+   its loading routine into free uncontended memory to keep timing exact, so
+   there must be 158 bytes above 32767 not used by data and machine stack. */
+
+#define TURBO_LOADER_ADDR   23760
+#define TURBO_FAST_ADDR     32768   /* uncontended memory */
+#define TURBO_UDG_ADDR      65368   /* user-defined graphics */
+#define TURBO_STACK_LEN     128     /* room for machine stack */
+#define TURBO_MIN_PULSES    800     /* pilot wait and 256 leader pulses */
+#define TURBO_MAX_LEN(n)    (36 + (n) * 13 + 158)
+
+struct turbo_block_t
+{
+    unsigned int address;
+    unsigned int length;
+};
+
+char turbo_check_timing (const struct tzx_timing_t *timing);
+char turbo_check_blocks (const struct turbo_block_t *blocks, unsigned int count,
+    unsigned int stack);
+unsigned int turbo_make_loader (char *dest, const struct tzx_timing_t *timing,
+    const struct turbo_block_t *blocks, unsigned int count, unsigned int exec,
+    unsigned int stack);
+
+#endif  /* !_turbo_h */
@@ -0,0 +1,71 @@
+/* tzxfile.c - `.tzx' tape file blocks.
+
+   `tzxfile.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <string.h>
+#include "tzxfile.h"
+
+/* Sets ROM loader timings */
+void tzx_init_timing (struct tzx_timing_t *timing)
+{
+    timing->pilot = TZX_ROM_PILOT;
+    timing->sync1 = TZX_ROM_SYNC1;
+    timing->sync2 = TZX_ROM_SYNC2;
+    timing->zero = TZX_ROM_ZERO;
+    timing->one = TZX_ROM_ONE;
+    timing->pulses = TZX_ROM_DATA_PULSES;
+    timing->pause = TZX_DEF_PAUSE;
+}
+
+/* Puts file header into `dest' (`TZX_HEADER_LEN' bytes long) */
+unsigned int tzx_put_header (char *dest)
+{
+    memcpy (dest, TZX_SIGNATURE, 8);
+    dest[8] = TZX_VERSION_MAJOR;
+    dest[9] = TZX_VERSION_MINOR;
+    return TZX_HEADER_LEN;
+}
+
+/* Returns the length of a block's prefix: turbo speed block is made when
+   `turbo' is not NULL */
+unsigned int tzx_get_prefix_len (const struct tzx_timing_t *turbo)
+{
+    return turbo ? TZX_TURBO_PREFIX_LEN : TZX_STANDARD_PREFIX_LEN;
+}
+
+static void put_word (char *dest, unsigned int x)
+{
+    dest[0] = x % 256;
+    dest[1] = x / 256;
+}
+
+/* Puts the prefix of a block of `type' with `len' bytes (`type' and checksum
+   included) into `dest' */
+void tzx_put_prefix (char *dest, const struct tzx_timing_t *turbo, char type,
+    unsigned int len)
+{
+    if (!turbo)
+    {
+        dest[0] = TZX_ID_STANDARD;
+        put_word (dest + 1, TZX_DEF_PAUSE);
+        put_word (dest + 3, len);
+        return;
+    }
+    dest[0] = TZX_ID_TURBO;
+    put_word (dest + 1, turbo->pilot);
+    put_word (dest + 3, turbo->sync1);
+    put_word (dest + 5, turbo->sync2);
+    put_word (dest + 7, turbo->zero);
+    put_word (dest + 9, turbo->one);
+    put_word (dest + 11, (unsigned char) type < 128 ? TZX_ROM_HEADER_PULSES : turbo->pulses);
+    dest[13] = 8;
+    put_word (dest + 14, turbo->pause);
+    put_word (dest + 16, len % 65536);
+    dest[18] = len / 65536;
+}
@@ -0,0 +1,78 @@
+/* tzxfile.h - declarations for `tzxfile.c'.
+
+   `tzxfile.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _tzxfile_h
+#define _tzxfile_h 1
+
+/* `.tzx' file starts with a 10 bytes long header followed by blocks. A block
+   holds the same data as a `.tap' block (`type', `data[]', `checksum') but
+   its 2 bytes long length is replaced by one of the prefixes below.
+
+   Standard speed data block (ID 10), 5 bytes prefix:
+
+   Offset    Type   Name      Description
+   0000      uint8  id        10
+   0001-0002 uint16 pause     pause after this block (ms)
+   0003-0004 uint16 length    of the data that follows
+
+   Turbo speed data block (ID 11), 19 bytes prefix:
+
+   Offset    Type   Name      Description
+   0000      uint8  id        11
+   0001-0002 uint16 pilot     length of pilot pulse (T-states)
+   0003-0004 uint16 sync1     length of first sync pulse
+   0005-0006 uint16 sync2     length of second sync pulse
+   0007-0008 uint16 zero      length of zero bit pulse
+   0009-000A uint16 one       length of one bit pulse
+   000B-000C uint16 pulses    length of pilot tone (number of pulses)
+   000D      uint8  bits      used bits in the last byte
+   000E-000F uint16 pause     pause after this block (ms)
+   0010-0012 uint24 length    of the data that follows */
+
+#define TZX_SIGNATURE       "ZXTape!\x1A"
+#define TZX_VERSION_MAJOR   1
+#define TZX_VERSION_MINOR   20
+#define TZX_HEADER_LEN      10
+
+#define TZX_ID_STANDARD     0x10
+#define TZX_ID_TURBO        0x11
+
+#define TZX_STANDARD_PREFIX_LEN 5
+#define TZX_TURBO_PREFIX_LEN    19
+
+/* ROM loader timings (T-states) */
+#define TZX_ROM_PILOT           2168
+#define TZX_ROM_SYNC1           667
+#define TZX_ROM_SYNC2           735
+#define TZX_ROM_ZERO            855
+#define TZX_ROM_ONE             1710
+#define TZX_ROM_HEADER_PULSES   8063
+#define TZX_ROM_DATA_PULSES     3223
+#define TZX_DEF_PAUSE           1000    /* ms */
+
+/* Timings of turbo speed data blocks */
+struct tzx_timing_t
+{
+    unsigned int pilot;
+    unsigned int sync1;
+    unsigned int sync2;
+    unsigned int zero;
+    unsigned int one;
+    unsigned int pulses;    /* of pilot tone of data blocks */
+    unsigned int pause;
+};
+
+void tzx_init_timing (struct tzx_timing_t *timing);
+unsigned int tzx_put_header (char *dest);
+unsigned int tzx_get_prefix_len (const struct tzx_timing_t *turbo);
+void tzx_put_prefix (char *dest, const struct tzx_timing_t *turbo, char type,
+    unsigned int len);
+
+#endif  /* !_tzxfile_h */
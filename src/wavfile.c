@@ -0,0 +1,236 @@
+/* wavfile.c - tape to `.wav' file renderer.
+
+   `wavfile.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "tzxfile.h"
+#include "wavfile.h"
+
+static char write_all (WAVFILE *self, const unsigned char *src, unsigned int len)
+{
+    ssize_t n;
+
+    while (len)
+    {
+        n = write (self->fd, src, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            self->error = WAV_ERR_WRITE;
+            return 1;
+        }
+        src += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void put_dword (unsigned char *dest, unsigned long x)
+{
+    dest[0] = x;
+    dest[1] = x >> 8;
+    dest[2] = x >> 16;
+    dest[3] = x >> 24;
+}
+
+/* Makes file header for `samples' samples in `dest' */
+static void make_header (WAVFILE *self, unsigned char *dest, unsigned long samples)
+{
+    memcpy (dest, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x01\0", 24);
+    put_dword (dest + 4, WAV_HEADER_LEN - 8 + samples);
+    put_dword (dest + 24, self->rate);          /* sample rate */
+    put_dword (dest + 28, self->rate);          /* byte rate */
+    memcpy (dest + 32, "\x01\0\x08\0data", 8);  /* block align, bits */
+    put_dword (dest + 40, samples);
+}
+
+/* Starts `.wav' file `fd' with `rate' samples per second */
+char wav_start (WAVFILE *self, int fd, unsigned int rate)
+{
+    self->fd = fd;
+    self->rate = rate;
+    self->level = WAV_LOW;
+    self->error = 0;
+    self->frac = 0;
+    self->samples = 0;
+    /* real lengths are written by `wav_end()' */
+    make_header (self, self->buf, 0);
+    self->size = WAV_HEADER_LEN;
+    return 0;
+}
+
+static void flush (WAVFILE *self)
+{
+    if (!self->error && write_all (self, self->buf, self->size))
+        return;
+    self->size = 0;
+}
+
+static void put_samples (WAVFILE *self, unsigned long n)
+{
+    unsigned int len;
+
+    self->samples += n;
+    while (n)
+    {
+        len = WAV_BUF_LEN - self->size;
+        if (len > n)
+            len = n;
+        memset (self->buf + self->size, self->level, len);
+        self->size += len;
+        n -= len;
+        if (self->size == WAV_BUF_LEN)
+            flush (self);
+    }
+}
+
+static void make_pulse (WAVFILE *self, struct wav_pulse_t *pulse, unsigned int t)
+{
+    unsigned long long x = (unsigned long long) t * self->rate;
+
+    pulse->len = x / WAV_CPU_CLOCK;
+    pulse->frac = x % WAV_CPU_CLOCK;
+}
+
+/* Puts a pulse and flips the level */
+static void put_pulse (WAVFILE *self, const struct wav_pulse_t *pulse)
+{
+    unsigned int len = pulse->len;
+
+    self->frac += pulse->frac;
+    if (self->frac >= WAV_CPU_CLOCK)
+    {
+        self->frac -= WAV_CPU_CLOCK;
+        len++;
+    }
+    put_samples (self, len);
+    self->level ^= WAV_LOW ^ WAV_HIGH;
+}
+
+/* Puts pilot tone, sync pulses, `len' bytes of `data' and pause */
+static void put_block (WAVFILE *self, const struct tzx_timing_t *timing,
+    const unsigned char *data, unsigned long len)
+{
+    struct wav_pulse_t pilot, sync1, sync2, bit[2];
+    const struct wav_pulse_t *p;
+    unsigned long n, edge;
+    unsigned int i, b;
+
+    make_pulse (self, &pilot, timing->pilot);
+    make_pulse (self, &sync1, timing->sync1);
+    make_pulse (self, &sync2, timing->sync2);
+    make_pulse (self, &bit[0], timing->zero);
+    make_pulse (self, &bit[1], timing->one);
+
+    for (i = 0; i < timing->pulses; i++)
+        put_pulse (self, &pilot);
+    put_pulse (self, &sync1);
+    put_pulse (self, &sync2);
+    for (; len; len--, data++)
+        for (b = 0x80; b; b >>= 1)
+        {
+            p = &bit[(*data & b) != 0];
+            put_pulse (self, p);
+            put_pulse (self, p);
+        }
+
+    /* the last pulse is ended by an edge: the first millisecond of pause keeps
+       the flipped level, the rest is low */
+    if (timing->pause)
+    {
+        n = (unsigned long) timing->pause * self->rate / 1000;
+        edge = self->rate / 1000;
+        if (edge > n)
+            edge = n;
+        put_samples (self, edge);
+        self->level = WAV_LOW;
+        put_samples (self, n - edge);
+    }
+}
+
+static unsigned int get_word (const unsigned char *src)
+{
+    return src[0] | (src[1] << 8);
+}
+
+/* Renders `size' bytes of blocks of `.tzx' tape (with no file header) */
+void wav_put_tape (WAVFILE *self, const char *data, unsigned long size)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    struct tzx_timing_t timing;
+    unsigned long len;
+
+    while (size && !self->error)
+    {
+        if (p[0] == TZX_ID_STANDARD && size >= TZX_STANDARD_PREFIX_LEN)
+        {
+            tzx_init_timing (&timing);
+            timing.pause = get_word (p + 1);
+            len = get_word (p + 3);
+            p += TZX_STANDARD_PREFIX_LEN;
+            size -= TZX_STANDARD_PREFIX_LEN;
+            if (len && len <= size && p[0] < 128)
+                timing.pulses = TZX_ROM_HEADER_PULSES;
+        }
+        else if (p[0] == TZX_ID_TURBO && size >= TZX_TURBO_PREFIX_LEN)
+        {
+            timing.pilot = get_word (p + 1);
+            timing.sync1 = get_word (p + 3);
+            timing.sync2 = get_word (p + 5);
+            timing.zero = get_word (p + 7);
+            timing.one = get_word (p + 9);
+            timing.pulses = get_word (p + 11);
+            timing.pause = get_word (p + 14);
+            len = get_word (p + 16) | ((unsigned long) p[18] << 16);
+            p += TZX_TURBO_PREFIX_LEN;
+            size -= TZX_TURBO_PREFIX_LEN;
+        }
+        else
+            len = size + 1;
+        if (len > size)
+        {
+            self->error = WAV_ERR_FORMAT;
+            return;
+        }
+        put_block (self, &timing, p, len);
+        p += len;
+        size -= len;
+    }
+}
+
+/* Writes the rest of samples and the file header */
+char wav_end (WAVFILE *self)
+{
+    unsigned char header[WAV_HEADER_LEN];
+
+    flush (self);
+    if (self->error)
+        return 1;
+    make_header (self, header, self->samples);
+    if (pwrite (self->fd, header, WAV_HEADER_LEN, 0) != WAV_HEADER_LEN)
+    {
+        self->error = WAV_ERR_WRITE;
+        return 1;
+    }
+    return 0;
+}
+
+char wav_get_error (WAVFILE *self)
+{
+    return self->error;
+}
+
+/* Returns the size of the whole file */
+unsigned long wav_get_size (WAVFILE *self)
+{
+    return WAV_HEADER_LEN + self->samples;
+}
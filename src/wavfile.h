@@ -0,0 +1,62 @@
+/* wavfile.h - declarations for `wavfile.c'.
+
+   `wavfile.c' is a part of `bintap' program.
+
+   Author:
+   Ivan Ivanovich Tatarinov, <ivan-tat@ya.ru>, 2020.
+
+   This is free and unencumbered software released into the public domain.
+   For more information, please refer to <http://unlicense.org> */
+
+#ifndef _wavfile_h
+#define _wavfile_h 1
+
+#include "tzxfile.h"
+
+/* Tape is rendered into 8-bit mono PCM `.wav' file. Each pulse of a block is
+   a run of samples of one level, the level is flipped after each pulse. Pulse
+   lengths are converted from T-states into samples in advance (see
+   `wav_pulse_t'), the fraction of a sample is carried to the next pulse, so
+   there is no drift. Samples are written by `WAV_BUF_LEN' bytes, the lengths
+   in the file header are patched by `wav_end()'. */
+
+#define WAV_HEADER_LEN  44
+#define WAV_BUF_LEN     65536
+#define WAV_CPU_CLOCK   3500000 /* T-states per second */
+#define WAV_DEF_RATE    44100
+#define WAV_MIN_RATE    8000
+#define WAV_MAX_RATE    192000
+
+#define WAV_LOW         0x40
+#define WAV_HIGH        0xC0
+
+/* Error codes */
+#define WAV_ERR_WRITE   1   /* failed to write output file */
+#define WAV_ERR_FORMAT  2   /* unknown block in tape */
+
+/* Pulse of `len' whole samples and `frac' of a sample (in 1/WAV_CPU_CLOCK) */
+struct wav_pulse_t
+{
+    unsigned int len;
+    unsigned int frac;
+};
+
+typedef struct
+{
+    int fd;
+    unsigned int rate;      /* samples per second */
+    unsigned char level;
+    char error;
+    unsigned long frac;     /* carried fraction of a sample */
+    unsigned long samples;  /* written to `fd' and in `buf' */
+    unsigned int size;      /* of `buf' */
+    unsigned char buf[WAV_BUF_LEN];
+} WAVFILE;
+
+char wav_start (WAVFILE *self, int fd, unsigned int rate);
+void wav_put_tape (WAVFILE *self, const char *data, unsigned long size);
+char wav_end (WAVFILE *self);
+char wav_get_error (WAVFILE *self);
+unsigned long wav_get_size (WAVFILE *self);
+
+#endif  /* !_wavfile_h */